@@ -17,6 +17,9 @@ if (SANITIZE AND COMPILER_CLANG)
     if (SANITIZE STREQUAL "undefined")
         set (UBSAN_FLAGS "-fsanitize=undefined")
         set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${SAN_FLAGS} ${UBSAN_FLAGS}")
+    elseif(SANITIZE STREQUAL "thread")
+        set (TSAN_FLAGS "-fsanitize=thread")
+        set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${SAN_FLAGS} ${TSAN_FLAGS}")
     elseif(SANITIZE STREQUAL "memory")
         set (MSAN_FLAGS "-fsanitize=memory")
         set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${SAN_FLAGS} ${MSAN_FLAGS}")
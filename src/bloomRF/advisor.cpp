@@ -0,0 +1,407 @@
+#include "advisor.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace filters {
+
+namespace {
+
+/// Number of positions at which a range size is evaluated.  The same
+/// positions are used for every delta vector, so that the search compares
+/// candidates on equal terms.
+constexpr size_t RANGE_POSITIONS = 16;
+
+uint64_t splitMix64(uint64_t& state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+}  // namespace
+
+struct BloomRFAdvisor::Model {
+  std::vector<size_t> shifts;
+  /// Probability that a bit of a layer that no key of the probed interval
+  /// maps to is set anyway.
+  std::vector<double> fills;
+  /// Number of keys per key of the domain.
+  double density;
+  /// Largest key of the domain.
+  uint64_t maxKey;
+
+  /// Probability that the checks of layer that cover [lo, hi], a part of
+  /// the empty range [l, h], report no key.  The nearest keys lie below l
+  /// and above h at distances of left and right.
+  double noFalsePositive(size_t layer,
+                         uint64_t lo,
+                         uint64_t hi,
+                         uint64_t l,
+                         uint64_t h,
+                         uint64_t left,
+                         uint64_t right) const {
+    size_t shift = shifts[layer];
+    uint64_t width = uint64_t{1} << shift;
+    uint64_t first = lo >> shift;
+    uint64_t last = hi >> shift;
+    auto isPartial = [&](uint64_t interval) {
+      uint64_t start = interval << shift;
+      return start < l || start + (width - 1) > h;
+    };
+
+    double covered = static_cast<double>(last - first) + 1;
+    double result = 1;
+    for (uint64_t interval : {first, last}) {
+      if (isPartial(interval)) {
+        covered -= 1;
+        result *= noFalsePositiveBelow(layer, interval << shift, l, h, left,
+                                       right);
+      }
+      if (first == last) {
+        break;
+      }
+    }
+    // Covered intervals lie within the empty range, so their bits are only
+    // set by collisions.
+    return result * std::pow(1 - fills[layer], covered);
+  }
+
+  /// Like noFalsePositive, for a partial check of layer that starts at
+  /// start: its probe has to fail, or the checks of the next lower layer
+  /// within it have to.
+  double noFalsePositiveBelow(size_t layer,
+                              uint64_t start,
+                              uint64_t l,
+                              uint64_t h,
+                              uint64_t left,
+                              uint64_t right) const {
+    // Intervals of the lowest layer are single keys, which are never
+    // partial.
+    assert(layer > 0);
+    uint64_t end = start + ((uint64_t{1} << shifts[layer]) - 1);
+    bool holdsKey = (start < l && l - start >= left) ||
+                    (end > h && end - h >= right);
+    double set = holdsKey ? 1 : fills[layer];
+    uint64_t lo = std::max(l, start);
+    uint64_t hi = std::min(h, end);
+    return (1 - set) +
+           set * noFalsePositive(layer - 1, lo, hi, l, h, left, right);
+  }
+
+  /// Distances from the range at which the partial checks of the layers end
+  /// below l (or above h), in ascending order.
+  std::vector<uint64_t> partialExtents(uint64_t l, uint64_t h, bool below)
+      const {
+    std::vector<uint64_t> extents;
+    for (size_t shift : shifts) {
+      uint64_t mask = (uint64_t{1} << shift) - 1;
+      uint64_t extent = below ? l & mask : (h | mask) - h;
+      if (extent > 0) {
+        extents.push_back(extent);
+      }
+    }
+    std::sort(extents.begin(), extents.end());
+    extents.erase(std::unique(extents.begin(), extents.end()), extents.end());
+    return extents;
+  }
+
+  /// Probabilities that the nearest key is at most each of extents away, or
+  /// further away than all of them, as pairs of a representative distance
+  /// and its probability.
+  std::vector<std::pair<uint64_t, double>> nearestKey(
+      const std::vector<uint64_t>& extents) const {
+    std::vector<std::pair<uint64_t, double>> distances;
+    double previous = 0;
+    for (uint64_t extent : extents) {
+      double within = -std::expm1(-density * static_cast<double>(extent));
+      distances.emplace_back(extent, within - previous);
+      previous = within;
+    }
+    distances.emplace_back(std::numeric_limits<uint64_t>::max(),
+                           1 - previous);
+    return distances;
+  }
+
+  /// Whether the partial checks really hold keys only depends on the
+  /// distances of the nearest keys on both sides of the range, so the
+  /// false positive rate is averaged over those.
+  double fpr(uint64_t l, uint64_t h) const {
+    auto lefts = nearestKey(partialExtents(l, h, true));
+    auto rights = nearestKey(partialExtents(l, h, false));
+    double noFalsePositives = 0;
+    for (const auto& [left, leftProbability] : lefts) {
+      for (const auto& [right, rightProbability] : rights) {
+        noFalsePositives +=
+            leftProbability * rightProbability *
+            noFalsePositive(shifts.size() - 1, l, h, l, h, left, right);
+      }
+    }
+    return 1 - noFalsePositives;
+  }
+};
+
+BloomRFAdvisor::BloomRFAdvisor(size_t keys_, double bitsPerKey, size_t keyBits_)
+    : keys(keys_), bits(keys_ * bitsPerKey), keyBits(keyBits_) {
+  if (keys == 0 || bits < 8) {
+    throw std::logic_error{"The advisor needs keys and memory for them."};
+  }
+  if (keyBits == 0 || keyBits > 64) {
+    throw std::logic_error{"Keys must have between 1 and 64 bits."};
+  }
+}
+
+void BloomRFAdvisor::addQueries(uint64_t rangeSize, double weight) {
+  if (rangeSize == 0) {
+    throw std::logic_error{"Ranges must hold at least one key."};
+  }
+  if (weight > 0) {
+    queries.emplace_back(rangeSize, weight);
+  }
+}
+
+void BloomRFAdvisor::addQuerySample(std::span<const uint64_t> rangeSizes) {
+  // Bucket by power of two and represent each bucket by its mean size.
+  std::map<int, std::pair<double, size_t>> buckets;
+  for (auto size : rangeSizes) {
+    if (size == 0) {
+      throw std::logic_error{"Ranges must hold at least one key."};
+    }
+    auto& [sum, count] = buckets[std::bit_width(size)];
+    sum += static_cast<double>(size);
+    ++count;
+  }
+  for (const auto& [bucket, sizes] : buckets) {
+    const auto& [sum, count] = sizes;
+    addQueries(static_cast<uint64_t>(std::llround(sum / count)), count);
+  }
+}
+
+std::vector<double> BloomRFAdvisor::setBits(
+    const std::vector<size_t>& delta) const {
+  // Each layer sets one bit per distinct prefix of the keys.
+  std::vector<double> bitsOfLayers;
+  size_t shift = 0;
+  for (size_t d : delta) {
+    double prefixes = std::ldexp(1.0, keyBits - shift);
+    bitsOfLayers.push_back(-prefixes * std::expm1(-(keys / prefixes)));
+    shift += d;
+  }
+  return bitsOfLayers;
+}
+
+BloomRFAdvisor::Model BloomRFAdvisor::buildModel(
+    const std::vector<size_t>& delta,
+    const std::vector<double>& layerBits) const {
+  Model model;
+  model.shifts.resize(delta.size());
+  std::exclusive_scan(delta.begin(), delta.end(), model.shifts.begin(),
+                      size_t{0});
+  double domain = std::ldexp(1.0, keyBits);
+  model.density = keys / domain;
+  model.maxKey = keyBits == 64 ? std::numeric_limits<uint64_t>::max()
+                               : (uint64_t{1} << keyBits) - 1;
+
+  std::vector<double> set = setBits(delta);
+  if (layerBits.empty()) {
+    double fill =
+        -std::expm1(-std::accumulate(set.begin(), set.end(), 0.0) / bits);
+    model.fills.assign(delta.size(), fill);
+  } else {
+    for (size_t i = 0; i < delta.size(); ++i) {
+      model.fills.push_back(-std::expm1(-set[i] / layerBits[i]));
+    }
+  }
+  return model;
+}
+
+double BloomRFAdvisor::averageFpr(const Model& model,
+                                  uint64_t rangeSize) const {
+  uint64_t span = std::min(rangeSize - 1, model.maxKey);
+  uint64_t state = rangeSize;
+  double sum = 0;
+  for (size_t i = 0; i < RANGE_POSITIONS; ++i) {
+    uint64_t low = splitMix64(state) & model.maxKey;
+    low = std::min(low, model.maxKey - span);
+    sum += model.fpr(low, low + span);
+  }
+  return sum / RANGE_POSITIONS;
+}
+
+double BloomRFAdvisor::predictFpr(const std::vector<size_t>& delta,
+                                  uint64_t rangeSize,
+                                  const std::vector<size_t>& layerSizes) const {
+  if (delta.empty() || std::accumulate(delta.begin(), delta.end(),
+                                       size_t{0}) > keyBits) {
+    throw std::logic_error{
+        "Sum of delta vector should not exceed width of key."};
+  }
+  if (!layerSizes.empty() && layerSizes.size() != delta.size()) {
+    throw std::logic_error{"There has to be one layer size per layer."};
+  }
+  std::vector<double> layerBits;
+  for (auto size : layerSizes) {
+    layerBits.push_back(8.0 * size);
+  }
+  return averageFpr(buildModel(delta, layerBits), rangeSize);
+}
+
+double BloomRFAdvisor::workloadFpr(const Model& model) const {
+  double sum = 0;
+  double weights = 0;
+  for (const auto& [rangeSize, weight] : queries) {
+    sum += weight * averageFpr(model, rangeSize);
+    weights += weight;
+  }
+  return sum / weights;
+}
+
+BloomRFAdvisor::Advice BloomRFAdvisor::advise() const {
+  if (queries.empty()) {
+    throw std::logic_error{"The advisor needs queries to tune for."};
+  }
+
+  auto cost = [this](const std::vector<size_t>& delta) {
+    return workloadFpr(buildModel(delta)) *
+           std::pow(1 + LAYER_PENALTY, delta.size());
+  };
+  auto valid = [this](const std::vector<size_t>& delta) {
+    return !delta.empty() && delta.size() <= MAX_LAYERS &&
+           std::accumulate(delta.begin(), delta.end(), size_t{0}) <=
+               keyBits &&
+           std::all_of(delta.begin(), delta.end(),
+                       [](size_t d) { return d >= 1 && d <= MAX_DELTA; });
+  };
+
+  // Start from the best vector of equal deltas.
+  std::vector<size_t> best;
+  double bestCost = std::numeric_limits<double>::infinity();
+  for (size_t d = 1; d <= MAX_DELTA; ++d) {
+    std::vector<size_t> delta(std::min(keyBits / d, MAX_LAYERS), d);
+    if (!valid(delta)) {
+      continue;
+    }
+    double c = cost(delta);
+    if (c < bestCost) {
+      best = std::move(delta);
+      bestCost = c;
+    }
+  }
+
+  // Then take the best of the neighbouring vectors, which differ by one in
+  // a single delta or by a layer of delta one, until none is better.
+  for (bool improved = true; improved;) {
+    improved = false;
+    std::vector<std::vector<size_t>> neighbours;
+    for (size_t i = 0; i < best.size(); ++i) {
+      auto grown = best;
+      ++grown[i];
+      neighbours.push_back(std::move(grown));
+      auto shrunk = best;
+      if (--shrunk[i] == 0) {
+        shrunk.erase(shrunk.begin() + i);
+      }
+      neighbours.push_back(std::move(shrunk));
+    }
+    for (size_t i = 0; i <= best.size(); ++i) {
+      auto inserted = best;
+      inserted.insert(inserted.begin() + i, 1);
+      neighbours.push_back(std::move(inserted));
+    }
+
+    for (auto& delta : neighbours) {
+      if (!valid(delta)) {
+        continue;
+      }
+      double c = cost(delta);
+      if (c < bestCost * (1 - 1e-9)) {
+        best = std::move(delta);
+        bestCost = c;
+        improved = true;
+      }
+    }
+  }
+
+  size_t filterSize = static_cast<size_t>(std::ceil(bits / 8));
+  return Advice{BloomFilterRFParameters{filterSize, 0, best},
+                averageFpr(buildModel(best), 1),
+                workloadFpr(buildModel(best))};
+}
+
+std::vector<size_t> BloomRFAdvisor::layerSizes(
+    const std::vector<size_t>& delta) const {
+  if (queries.empty()) {
+    throw std::logic_error{"The advisor needs queries to tune for."};
+  }
+  if (delta.empty() || std::accumulate(delta.begin(), delta.end(),
+                                       size_t{0}) > keyBits) {
+    throw std::logic_error{
+        "Sum of delta vector should not exceed width of key."};
+  }
+
+  // Splitting the memory in proportion to the bits that the layers set
+  // gives every layer the fill of a shared filter, and the same false
+  // positive rate.  From there, move memory between pairs of layers while
+  // that lowers the false positive rate, in ever smaller steps.  No layer
+  // gets less than a cache line, or than the widest PMHF word, which a
+  // filter does not accept.
+  size_t widest = *std::max_element(delta.begin(), delta.end());
+  const double minLayerBits =
+      std::max(8.0 * detail::FILTER_ALIGNMENT, std::ldexp(1.0, static_cast<int>(widest) - 1));
+  std::vector<double> set = setBits(delta);
+  double setSum = std::accumulate(set.begin(), set.end(), 0.0);
+  std::vector<double> layerBits;
+  for (double s : set) {
+    layerBits.push_back(std::max(minLayerBits, bits * s / setSum));
+  }
+  double fpr = workloadFpr(buildModel(delta, layerBits));
+
+  for (double step = bits / 16; step >= bits / 1024; step /= 2) {
+    for (bool improved = true; improved;) {
+      improved = false;
+      for (size_t from = 0; from < delta.size(); ++from) {
+        for (size_t to = 0; to < delta.size(); ++to) {
+          if (from == to || layerBits[from] - step < minLayerBits) {
+            continue;
+          }
+          auto moved = layerBits;
+          moved[from] -= step;
+          moved[to] += step;
+          double movedFpr = workloadFpr(buildModel(delta, moved));
+          if (movedFpr < fpr * (1 - 1e-9)) {
+            layerBits = std::move(moved);
+            fpr = movedFpr;
+            improved = true;
+          }
+        }
+      }
+    }
+  }
+
+  // Whole multiples of the minimum per layer, with the remainder on the
+  // largest layer, so that the sizes add up to the advised filter size.
+  size_t filterSize = static_cast<size_t>(std::ceil(bits / 8));
+  std::vector<size_t> sizes;
+  for (double b : layerBits) {
+    size_t units = static_cast<size_t>(b / minLayerBits);
+    sizes.push_back(std::max<size_t>(units, 1) *
+                    static_cast<size_t>(minLayerBits / 8));
+  }
+  auto largest = std::max_element(sizes.begin(), sizes.end());
+  size_t others = std::accumulate(sizes.begin(), sizes.end(), size_t{0}) -
+                  *largest;
+  *largest = filterSize - std::min(others, filterSize - 1);
+  return sizes;
+}
+
+}  // namespace filters
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "bloomRF.h"
+
+namespace filters {
+
+//
+// Chooses the delta vector of a BloomRF for a workload, following the cost
+// model of the bloomRF paper.  Keys are assumed to be spread uniformly over
+// the key domain.  A probe of a layer is a false positive if its bit was set
+// by another key, which happens with the fill rate of the filter, unless the
+// probed interval really holds a key outside of the queried range.  The
+// false positive rate of an empty range then follows from the dyadic
+// decomposition that findRange walks: the intervals covered by the range have
+// to be empty, and the intervals on its boundaries only lead to lower layers
+// if their bit is set.
+//
+class BloomRFAdvisor {
+ public:
+  struct Advice {
+    BloomFilterRFParameters params;
+    /// Predicted false positive rate of point queries.
+    double point_fpr;
+    /// Predicted false positive rate averaged over the queries of the
+    /// workload.
+    double range_fpr;
+  };
+
+  /// A filter for keys of keyBits bits with a budget of bitsPerKey bits per
+  /// key.
+  BloomRFAdvisor(size_t keys, double bitsPerKey, size_t keyBits);
+
+  template <typename Key>
+  static BloomRFAdvisor forKey(size_t keys, double bitsPerKey) {
+    return BloomRFAdvisor(keys, bitsPerKey, 8 * sizeof(Key));
+  }
+
+  /// Adds weight queries of ranges of rangeSize keys, 1 for point queries.
+  void addQueries(uint64_t rangeSize, double weight = 1);
+
+  /// Adds a sample of query range sizes.  Sizes are grouped by their
+  /// power of two, so that large samples stay cheap to evaluate.
+  void addQuerySample(std::span<const uint64_t> rangeSizes);
+
+  /// Searches for the delta vector with the lowest false positive rate over
+  /// the workload.  Every layer costs a probe, so a layer is only added if
+  /// it lowers the false positive rate by more than LAYER_PENALTY.  Throws
+  /// std::logic_error if no queries were added.
+  Advice advise() const;
+
+  /// Splits the memory budget of a filter with the given delta vector
+  /// between the sub-arrays of its layers (BloomFilterRFParameters::
+  /// layer_sizes), so that the false positive rate over the workload is
+  /// lowest.  The sizes add up to the filter size of advise.  Throws
+  /// std::logic_error if no queries were added.
+  std::vector<size_t> layerSizes(const std::vector<size_t>& delta) const;
+
+  /// Predicted false positive rate of empty ranges of rangeSize keys for a
+  /// filter with the given delta vector, and optionally layer sizes.
+  double predictFpr(const std::vector<size_t>& delta,
+                    uint64_t rangeSize,
+                    const std::vector<size_t>& layerSizes = {}) const;
+
+  /// Relative false positive rate that a layer has to save to be added.
+  static constexpr double LAYER_PENALTY = 0.01;
+
+  /// Largest delta the search considers.  Larger deltas give PMHF words of
+  /// thousands of bits that range queries have to scan.
+  static constexpr size_t MAX_DELTA = 12;
+
+  /// Most layers the search considers.
+  static constexpr size_t MAX_LAYERS = 16;
+
+ private:
+  /// The fill rate and the placement of ranges are shared by all range
+  /// sizes of a delta vector.
+  struct Model;
+
+  /// Expected number of bits that the keys set on each layer.
+  std::vector<double> setBits(const std::vector<size_t>& delta) const;
+
+  /// layerBits holds the bits of the sub-array of each layer, or is empty if
+  /// the layers share the filter.
+  Model buildModel(const std::vector<size_t>& delta,
+                   const std::vector<double>& layerBits = {}) const;
+
+  /// Average predicted false positive rate of ranges of rangeSize keys at
+  /// RANGE_POSITIONS fixed pseudo-random positions.
+  double averageFpr(const Model& model, uint64_t rangeSize) const;
+
+  /// Predicted false positive rate over the workload.
+  double workloadFpr(const Model& model) const;
+
+  size_t keys;
+  double bits;
+  size_t keyBits;
+  std::vector<std::pair<uint64_t, double>> queries;
+};
+
+}  // namespace filters
@@ -0,0 +1,328 @@
+#include "bitRange.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace filters {
+
+namespace detail {
+
+namespace {
+
+bool anyBitInRangeScalar(const uint64_t* words, size_t lowBit, size_t highBit) {
+  size_t first = lowBit / 64;
+  size_t last = highBit / 64;
+  for (size_t i = first; i <= last; ++i) {
+    uint64_t bitmask = ~uint64_t{0};
+    if (i == first) {
+      bitmask &= ~uint64_t{0} << (lowBit % 64);
+    }
+    if (i == last) {
+      bitmask &= ~uint64_t{0} >> (63 - highBit % 64);
+    }
+    if ((words[i] & bitmask) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Combines the bytes from begin on one byte at a time.  Used for the tail
+/// that does not fill a vector.
+void combineBytes(unsigned char* dst,
+                  const unsigned char* src,
+                  size_t begin,
+                  size_t bytes,
+                  WordOp op) {
+  for (size_t i = begin; i < bytes; ++i) {
+    dst[i] = op == WordOp::Or ? dst[i] | src[i] : dst[i] & src[i];
+  }
+}
+
+void combineWordsScalar(void* dst, const void* src, size_t bytes, WordOp op) {
+  auto* d = static_cast<unsigned char*>(dst);
+  const auto* s = static_cast<const unsigned char*>(src);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    // memcpy, since the words of a filter may be narrower than uint64_t.
+    uint64_t a, b;
+    std::memcpy(&a, d + i, sizeof(a));
+    std::memcpy(&b, s + i, sizeof(b));
+    a = op == WordOp::Or ? a | b : a & b;
+    std::memcpy(d + i, &a, sizeof(a));
+  }
+  combineBytes(d, s, i, bytes, op);
+}
+
+/// Counts the bits of the bytes from begin on one byte at a time.  Used for
+/// the tail that does not fill a vector.
+size_t countBytes(const unsigned char* words, size_t begin, size_t bytes) {
+  size_t count = 0;
+  for (size_t i = begin; i < bytes; ++i) {
+    count += std::popcount(words[i]);
+  }
+  return count;
+}
+
+size_t countBitsScalar(const void* words, size_t bytes) {
+  const auto* w = static_cast<const unsigned char*>(words);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, w + i, sizeof(word));
+    count += std::popcount(word);
+  }
+  return count + countBytes(w, i, bytes);
+}
+
+#if defined(__x86_64__)
+
+// Both kernels test a vector of words at a time.  The bit masks of the first
+// and the last word of the range are built by shifting all ones per lane, and
+// lanes past the last word are neither loaded nor tested.
+
+__attribute__((target("avx2"))) bool anyBitInRangeAvx2(const uint64_t* words,
+                                                       size_t lowBit,
+                                                       size_t highBit) {
+  const long long first = lowBit / 64;
+  const long long last = highBit / 64;
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i firstWord = _mm256_set1_epi64x(first);
+  const __m256i lastWord = _mm256_set1_epi64x(last);
+  const __m256i lowShift = _mm256_set1_epi64x(lowBit % 64);
+  const __m256i highShift = _mm256_set1_epi64x(63 - highBit % 64);
+
+  for (long long i = first; i <= last; i += 4) {
+    __m256i index = _mm256_add_epi64(_mm256_set1_epi64x(i), lanes);
+    __m256i inRange = _mm256_cmpgt_epi64(
+        _mm256_add_epi64(lastWord, _mm256_set1_epi64x(1)), index);
+    __m256i word = _mm256_maskload_epi64(
+        reinterpret_cast<const long long*>(words + i), inRange);
+
+    __m256i low = _mm256_and_si256(_mm256_cmpeq_epi64(index, firstWord),
+                                   lowShift);
+    __m256i high = _mm256_and_si256(_mm256_cmpeq_epi64(index, lastWord),
+                                    highShift);
+    __m256i bitmask = _mm256_and_si256(_mm256_sllv_epi64(ones, low),
+                                       _mm256_srlv_epi64(ones, high));
+    bitmask = _mm256_and_si256(bitmask, inRange);
+    if (!_mm256_testz_si256(word, bitmask)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+__attribute__((target("avx512f"))) bool anyBitInRangeAvx512(
+    const uint64_t* words,
+    size_t lowBit,
+    size_t highBit) {
+  const uint64_t first = lowBit / 64;
+  const uint64_t last = highBit / 64;
+  const __m512i ones = _mm512_set1_epi64(-1);
+  const __m512i lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m512i firstWord = _mm512_set1_epi64(first);
+  const __m512i lastWord = _mm512_set1_epi64(last);
+  const __m512i lowShift = _mm512_set1_epi64(lowBit % 64);
+  const __m512i highShift = _mm512_set1_epi64(63 - highBit % 64);
+
+  for (uint64_t i = first; i <= last; i += 8) {
+    __m512i index = _mm512_add_epi64(_mm512_set1_epi64(i), lanes);
+    __mmask8 inRange = _mm512_cmple_epu64_mask(index, lastWord);
+    __m512i word = _mm512_maskz_loadu_epi64(inRange, words + i);
+
+    __m512i low = _mm512_maskz_mov_epi64(
+        _mm512_cmpeq_epu64_mask(index, firstWord), lowShift);
+    __m512i high = _mm512_maskz_mov_epi64(
+        _mm512_cmpeq_epu64_mask(index, lastWord), highShift);
+    __m512i bitmask = _mm512_and_si512(_mm512_sllv_epi64(ones, low),
+                                       _mm512_srlv_epi64(ones, high));
+    if (_mm512_mask_test_epi64_mask(inRange, word, bitmask) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+__attribute__((target("avx2"))) void combineWordsAvx2(void* dst,
+                                                      const void* src,
+                                                      size_t bytes,
+                                                      WordOp op) {
+  auto* d = static_cast<unsigned char*>(dst);
+  const auto* s = static_cast<const unsigned char*>(src);
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= bytes; i += sizeof(__m256i)) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(d + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+    a = op == WordOp::Or ? _mm256_or_si256(a, b) : _mm256_and_si256(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), a);
+  }
+  combineBytes(d, s, i, bytes, op);
+}
+
+__attribute__((target("avx512f"))) void combineWordsAvx512(void* dst,
+                                                           const void* src,
+                                                           size_t bytes,
+                                                           WordOp op) {
+  auto* d = static_cast<unsigned char*>(dst);
+  const auto* s = static_cast<const unsigned char*>(src);
+  size_t i = 0;
+  for (; i + sizeof(__m512i) <= bytes; i += sizeof(__m512i)) {
+    __m512i a = _mm512_loadu_si512(d + i);
+    __m512i b = _mm512_loadu_si512(s + i);
+    a = op == WordOp::Or ? _mm512_or_si512(a, b) : _mm512_and_si512(a, b);
+    _mm512_storeu_si512(d + i, a);
+  }
+  combineBytes(d, s, i, bytes, op);
+}
+
+/// Counts the bits of each nibble with a lookup table in a shuffle and sums
+/// the bytes of every lane with a sum of absolute differences (Mula's
+/// algorithm).
+__attribute__((target("avx2"))) size_t countBitsAvx2(const void* words,
+                                                     size_t bytes) {
+  const auto* w = static_cast<const unsigned char*>(words);
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowNibbles = _mm256_set1_epi8(0x0f);
+  __m256i sums = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + sizeof(__m256i) <= bytes; i += sizeof(__m256i)) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+    __m256i low = _mm256_and_si256(v, lowNibbles);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowNibbles);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low),
+                                     _mm256_shuffle_epi8(lookup, high));
+    sums = _mm256_add_epi64(sums,
+                            _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+  }
+  size_t count = _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                 _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+  return count + countBytes(w, i, bytes);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) size_t countBitsAvx512(
+    const void* words,
+    size_t bytes) {
+  const auto* w = static_cast<const unsigned char*>(words);
+  __m512i sums = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + sizeof(__m512i) <= bytes; i += sizeof(__m512i)) {
+    sums = _mm512_add_epi64(sums,
+                            _mm512_popcnt_epi64(_mm512_loadu_si512(w + i)));
+  }
+  return _mm512_reduce_add_epi64(sums) + countBytes(w, i, bytes);
+}
+
+bool supportsVpopcntdq() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512vpopcntdq");
+}
+
+#endif
+
+using Kernel = bool (*)(const uint64_t*, size_t, size_t);
+using CombineKernel = void (*)(void*, const void*, size_t, WordOp);
+using CountKernel = size_t (*)(const void*, size_t);
+
+Kernel kernelFor(SimdLevel level) {
+  switch (level) {
+#if defined(__x86_64__)
+    case SimdLevel::Avx512:
+      return anyBitInRangeAvx512;
+    case SimdLevel::Avx2:
+      return anyBitInRangeAvx2;
+#endif
+    default:
+      return anyBitInRangeScalar;
+  }
+}
+
+CombineKernel combineKernelFor(SimdLevel level) {
+  switch (level) {
+#if defined(__x86_64__)
+    case SimdLevel::Avx512:
+      return combineWordsAvx512;
+    case SimdLevel::Avx2:
+      return combineWordsAvx2;
+#endif
+    default:
+      return combineWordsScalar;
+  }
+}
+
+/// AVX-512 without VPOPCNTDQ counts with the AVX2 kernel.
+CountKernel countKernelFor(SimdLevel level) {
+  switch (level) {
+#if defined(__x86_64__)
+    case SimdLevel::Avx512:
+      return supportsVpopcntdq() ? countBitsAvx512 : countBitsAvx2;
+    case SimdLevel::Avx2:
+      return countBitsAvx2;
+#endif
+    default:
+      return countBitsScalar;
+  }
+}
+
+}  // namespace
+
+SimdLevel supportedSimdLevel() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::Avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::Avx2;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+bool anyBitInRange(const uint64_t* words, size_t lowBit, size_t highBit) {
+  static const Kernel kernel = kernelFor(supportedSimdLevel());
+  return kernel(words, lowBit, highBit);
+}
+
+bool anyBitInRange(const uint64_t* words,
+                   size_t lowBit,
+                   size_t highBit,
+                   SimdLevel level) {
+  return kernelFor(level)(words, lowBit, highBit);
+}
+
+void combineWords(void* dst, const void* src, size_t bytes, WordOp op) {
+  static const CombineKernel kernel = combineKernelFor(supportedSimdLevel());
+  kernel(dst, src, bytes, op);
+}
+
+void combineWords(void* dst,
+                  const void* src,
+                  size_t bytes,
+                  WordOp op,
+                  SimdLevel level) {
+  combineKernelFor(level)(dst, src, bytes, op);
+}
+
+size_t countBits(const void* words, size_t bytes) {
+  static const CountKernel kernel = countKernelFor(supportedSimdLevel());
+  return kernel(words, bytes);
+}
+
+size_t countBits(const void* words, size_t bytes, SimdLevel level) {
+  return countKernelFor(level)(words, bytes);
+}
+
+}  // namespace detail
+
+}  // namespace filters
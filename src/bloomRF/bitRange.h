@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace filters {
+
+namespace detail {
+
+/// Instruction sets that anyBitInRange can use.
+enum class SimdLevel {
+  Scalar,
+  Avx2,
+  Avx512,
+};
+
+/// The best instruction set that the CPU supports.
+SimdLevel supportedSimdLevel();
+
+/// Returns whether any of the bits lowBit to highBit (inclusive) of words is
+/// set, where bit i is bit i % 64 of words[i / 64].  Dispatches to the best
+/// kernel for the CPU, which tests 8 words per instruction with AVX-512.
+bool anyBitInRange(const uint64_t* words, size_t lowBit, size_t highBit);
+
+/// Like anyBitInRange, but with the given kernel, which the CPU has to
+/// support.  Meant for tests and benchmarks.
+bool anyBitInRange(const uint64_t* words,
+                   size_t lowBit,
+                   size_t highBit,
+                   SimdLevel level);
+
+/// How combineWords merges two arrays of words.
+enum class WordOp {
+  Or,
+  And,
+};
+
+/// Sets dst[i] = dst[i] op src[i] for the bytes bytes of dst and src.
+/// Dispatches to the best kernel for the CPU, which combines 64 bytes per
+/// instruction with AVX-512.
+void combineWords(void* dst, const void* src, size_t bytes, WordOp op);
+
+/// Like combineWords, but with the given kernel, which the CPU has to
+/// support.  Meant for tests and benchmarks.
+void combineWords(void* dst,
+                  const void* src,
+                  size_t bytes,
+                  WordOp op,
+                  SimdLevel level);
+
+/// Returns the number of set bits of the bytes bytes of words.  Dispatches
+/// to the best kernel for the CPU, which counts 64 bytes per instruction with
+/// AVX-512 VPOPCNTDQ.
+size_t countBits(const void* words, size_t bytes);
+
+/// Like countBits, but with the given kernel, which the CPU has to support.
+/// Meant for tests and benchmarks.
+size_t countBits(const void* words, size_t bytes, SimdLevel level);
+
+}  // namespace detail
+
+}  // namespace filters
@@ -1,56 +1,185 @@
 #include "bloomRF.h"
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <cstddef>
 #include <cstdlib>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <new>
 #include <numeric>
+#include <optional>
 #include <sstream>
+#include <string>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
+#include "bitRange.h"
 #include "city/city.h"
 
 namespace filters {
 
 namespace {
 
-constexpr uint64_t SEED_GEN_A = 845897321;
-constexpr uint64_t SEED_GEN_B = 217728422;
-
 constexpr uint64_t MAX_BLOOM_FILTER_SIZE = 1 << 30;
 
+/// Size of a block of the blocked layout in bits.
+constexpr size_t BLOCK_BITS = 8 * detail::FILTER_ALIGNMENT;
+
+/// log2 of the bits of an UnderType.
+template <typename UnderType>
+constexpr size_t UNDER_TYPE_BITS_LOG = std::countr_zero(8 * sizeof(UnderType));
+
+/// By default, a layer is blocked if its key prefixes outnumber the blocks
+/// by this factor, so that uniform keys spread evenly over the blocks.
+constexpr size_t MIN_PREFIXES_PER_BLOCK = 64;
+
+//
+// Serialized format.  All integers are little-endian.
+//
+//   magic            4 bytes  "BLRF"
+//   version          uint32
+//   key type         uint8    (KeyType)
+//   UnderType bytes  uint8
+//   hash policy      uint8    (HashPolicy::id)
+//   layers           uint8    (size of the delta vector)
+//   seed             uint64
+//   words            uint64   (number of UnderType words)
+//   delta            uint8 per layer
+//   layout           uint8    (Layout, since version 3)
+//   blocked layers   uint8    (0 for the flat layout, since version 3)
+//   partitioned      uint8    (1 if layers have sub-arrays, since version 4)
+//   layer words      uint64 per layer (only if partitioned)
+//   reduction        uint8    (IndexReduction, since version 5)
+//   padding          zero bytes up to a multiple of 64 (since version 2)
+//   filter words     UnderType per word
+//   checksum         uint64   (over everything before it)
+//
+// The padding keeps the words of a buffer that is itself cache line (or
+// page) aligned cache line aligned, which is what lets BloomRFView use the
+// words of a mapped file in place.
+//
+constexpr char SERIALIZATION_MAGIC[4] = {'B', 'L', 'R', 'F'};
+constexpr uint32_t SERIALIZATION_VERSION = 5;
+constexpr size_t SERIALIZATION_FIXED_HEADER_SIZE = 28;
+constexpr size_t SERIALIZATION_WORDS_ALIGNMENT = 64;
+
+template <typename Int>
+void appendLittleEndian(std::vector<char>& out, Int value) {
+  for (size_t i = 0; i < sizeof(Int); ++i) {
+    out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (8 * i)));
+  }
+}
+
+template <typename Int>
+Int loadLittleEndian(const char* in) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < sizeof(Int); ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i]))
+             << (8 * i);
+  }
+  return static_cast<Int>(value);
+}
+
+template <typename Int>
+Int byteSwap(Int value) {
+  Int swapped = 0;
+  for (size_t i = 0; i < sizeof(Int); ++i) {
+    swapped = (swapped << 8) | ((value >> (8 * i)) & 0xff);
+  }
+  return swapped;
+}
+
+/// Converts words between native and little-endian order in place.
+template <typename UnderType>
+void wordsToFromLittleEndian(UnderType* words, size_t n) {
+  if constexpr (std::endian::native == std::endian::big) {
+    for (size_t i = 0; i < n; ++i) {
+      words[i] = byteSwap(words[i]);
+    }
+  }
+}
+
+/// Words that the sub-arrays of per-layer sizes are multiples of: whole
+/// cache lines and whole PMHF words of any layer, so that all of them start
+/// aligned.  SIZE_MAX if a PMHF word is wider than any filter could be.
+template <typename UnderType>
+size_t layerAlignment(const std::vector<size_t>& delta) {
+  size_t alignment = detail::FILTER_ALIGNMENT / sizeof(UnderType);
+  for (auto d : delta) {
+    if (d - 1 >= 8 * sizeof(size_t)) {
+      return std::numeric_limits<size_t>::max();
+    }
+    alignment =
+        std::max(alignment, (size_t{1} << (d - 1)) / (8 * sizeof(UnderType)));
+  }
+  return alignment;
+}
+
 }  // namespace
 
-BloomFilterRFParameters::BloomFilterRFParameters(size_t filter_size_,
-                                                 size_t seed_,
-                                                 std::vector<size_t> delta_)
-    : filter_size(filter_size_), seed(seed_), delta(std::move(delta_)) {
+BloomFilterRFParameters::BloomFilterRFParameters(
+    size_t filter_size_,
+    size_t seed_,
+    std::vector<size_t> delta_,
+    Layout layout_,
+    size_t blocked_layers_,
+    std::vector<size_t> layer_sizes_,
+    IndexReduction reduction_)
+    : filter_size(filter_size_),
+      seed(seed_),
+      delta(std::move(delta_)),
+      layout(layout_),
+      blocked_layers(blocked_layers_),
+      layer_sizes(std::move(layer_sizes_)),
+      reduction(reduction_) {
   if (filter_size == 0)
     throw std::logic_error{"The size of bloom filter cannot be zero"};
 }
 
 namespace detail {
 
-template <typename T, typename UnderType>
-BloomRfImpl<T, UnderType>::BloomRfImpl(const BloomFilterRFParameters& params)
-    : BloomRfImpl<T, UnderType>(params.filter_size, params.seed, params.delta) {
-}
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::BloomRfImpl(
+    const BloomFilterRFParameters& params)
+    : BloomRfImpl<T, UnderType, HashPolicy>(params, nullptr) {}
 
-template <typename T, typename UnderType>
-size_t BloomRfImpl<T, UnderType>::bloomRFHashToWord(T data, size_t i) const {
+template <typename T, typename UnderType, typename HashPolicy>
+size_t BloomRfImpl<T, UnderType, HashPolicy>::bloomRFHashToWord(
+    T data,
+    size_t i,
+    size_t block) const {
   auto hash = this->hash(data >> (shifts[i] + delta[i] - 1), i);
-  return hash % (numBits() >> (delta[i] - 1));
+  if (i < blockedLayers) {
+    size_t wordsPerBlock = BLOCK_BITS >> (delta[i] - 1);
+    return block * wordsPerBlock + (hash & (wordsPerBlock - 1));
+  }
+  return layerFirstPmhfWord[i] + reduce(hash, layerPmhfWords[i]);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+size_t BloomRfImpl<T, UnderType, HashPolicy>::blockOf(T data) const {
+  if (blockedLayers == 0) {
+    return 0;
+  }
+  // Every check of a range query lies within one PMHF word of its layer, so
+  // hashing the prefix of the highest blocked layer keeps all blocked probes
+  // of a check in the same block.
+  return reduce(hash(data >> blockShift, hashes), blocks);
 }
 
-template <typename T, typename UnderType>
-UnderType BloomRfImpl<T, UnderType>::bloomRFRemainder(T data,
-                                                      size_t i,
-                                                      int wordPos) const {
+template <typename T, typename UnderType, typename HashPolicy>
+UnderType BloomRfImpl<T, UnderType, HashPolicy>::bloomRFRemainder(
+    T data,
+    size_t i,
+    int wordPos) const {
   UnderType offset =
       (data >> shifts[i]) & ((UnderType{1} << (delta[i] - 1)) - 1);
 
@@ -62,47 +191,163 @@ UnderType BloomRfImpl<T, UnderType>::bloomRFRemainder(T data,
   return ret;
 }
 
-template <typename T, typename UnderType>
-size_t BloomRfImpl<T, UnderType>::hash(T data, size_t i) const {
-  size_t hash1 = CityHash64WithSeed(reinterpret_cast<const char*>(&data),
-                                    sizeof(data), seed);
-  size_t hash2 =
-      CityHash64WithSeed(reinterpret_cast<const char*>(&data), sizeof(data),
-                         SEED_GEN_A * seed + SEED_GEN_B);
-  return hash1 + i * hash2 + i * i;
+template <typename T, typename UnderType, typename HashPolicy>
+size_t BloomRfImpl<T, UnderType, HashPolicy>::hash(T data, size_t i) const {
+  return HashPolicy::hash(data, seed, i);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::add(T data) {
+  addKey<false>(data);
 }
 
-template <typename T, typename UnderType>
-void BloomRfImpl<T, UnderType>::add(T data) {
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::addConcurrent(T data) {
+  addKey<true>(data);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+template <bool Concurrent>
+void BloomRfImpl<T, UnderType, HashPolicy>::addKey(T data) {
+  size_t block = blockOf(data);
   for (size_t i = 0; i < hashes; ++i) {
-    auto hash = hashToIndexAndBitMask(data, i);
-    filter[hash.first] |= hash.second;
+    auto hash = wordToIndexAndBitMask(data, i,
+                                      bloomRFHashToWord(data, i, block));
+    orWord<Concurrent>(hash.first, hash.second);
+  }
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::addBatch(std::span<const T> data) {
+  addKeys<false>(data);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::addBatchConcurrent(
+    std::span<const T> data) {
+  addKeys<true>(data);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::addBatchParallel(
+    std::span<const T> data,
+    size_t threads) {
+  forEachSliceInParallel(data.size(), threads,
+                         [this, data](size_t begin, size_t end) {
+                           addKeys<true>(data.subspan(begin, end - begin));
+                         });
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+template <bool Concurrent>
+void BloomRfImpl<T, UnderType, HashPolicy>::addKeys(std::span<const T> data) {
+  std::array<std::pair<size_t, UnderType>, BATCH_SIZE> positions;
+  std::array<size_t, BATCH_SIZE> blockIds;
+
+  for (size_t begin = 0; begin < data.size(); begin += BATCH_SIZE) {
+    size_t n = std::min(BATCH_SIZE, data.size() - begin);
+    const T* block = data.data() + begin;
+    for (size_t j = 0; j < n; ++j) {
+      blockIds[j] = blockOf(block[j]);
+    }
+
+    for (size_t i = 0; i < hashes; ++i) {
+      // Keys that share the prefix hashed by this layer map to the same
+      // PMHF word.  Runs of such keys are common in sorted input (and in the
+      // upper layers in general), so only hash when the prefix changes.  Such
+      // keys also share their block, whose prefix is never longer.
+      size_t prefixShift = shifts[i] + delta[i] - 1;
+      size_t pos = 0;
+      for (size_t j = 0; j < n; ++j) {
+        if (j == 0 ||
+            (block[j] >> prefixShift) != (block[j - 1] >> prefixShift)) {
+          pos = bloomRFHashToWord(block[j], i, blockIds[j]);
+        }
+        positions[j] = wordToIndexAndBitMask(block[j], i, pos);
+        __builtin_prefetch(&filter[positions[j].first], 1);
+      }
+      for (size_t j = 0; j < n; ++j) {
+        orWord<Concurrent>(positions[j].first, positions[j].second);
+      }
+    }
   }
 }
 
-template <typename T, typename UnderType>
-bool BloomRfImpl<T, UnderType>::find(T data) const {
+template <typename T, typename UnderType, typename HashPolicy>
+bool BloomRfImpl<T, UnderType, HashPolicy>::find(T data) const {
+  size_t block = blockOf(data);
   for (size_t i = 0; i < hashes; ++i) {
-    const auto& [filterPos, bitmask] = hashToIndexAndBitMask(data, i);
-    if (!(filter[filterPos] & bitmask)) {
+    const auto& [filterPos, bitmask] =
+        wordToIndexAndBitMask(data, i, bloomRFHashToWord(data, i, block));
+    if (!(loadWord(filterPos) & bitmask)) {
       return false;
     }
   }
   return true;
 }
 
-template <typename T, typename UnderType>
-std::pair<size_t, UnderType> BloomRfImpl<T, UnderType>::hashToIndexAndBitMask(
-    T data,
-    size_t i) const {
-  size_t pos = bloomRFHashToWord(data, i);
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::findBatch(std::span<const T> data,
+                                                      bool* out) const {
+  std::array<std::pair<size_t, UnderType>, BATCH_SIZE> positions;
+  // Indices (relative to the block) of the keys that passed every layer so
+  // far.
+  std::array<size_t, BATCH_SIZE> alive;
+  std::array<size_t, BATCH_SIZE> blockIds;
+
+  for (size_t begin = 0; begin < data.size(); begin += BATCH_SIZE) {
+    size_t n = std::min(BATCH_SIZE, data.size() - begin);
+    const T* block = data.data() + begin;
+
+    size_t numAlive = n;
+    for (size_t j = 0; j < n; ++j) {
+      alive[j] = j;
+      out[begin + j] = false;
+      blockIds[j] = blockOf(block[j]);
+    }
+
+    for (size_t i = 0; i < hashes && numAlive > 0; ++i) {
+      for (size_t j = 0; j < numAlive; ++j) {
+        T key = block[alive[j]];
+        positions[j] = wordToIndexAndBitMask(
+            key, i, bloomRFHashToWord(key, i, blockIds[alive[j]]));
+        __builtin_prefetch(&filter[positions[j].first]);
+      }
+
+      size_t stillAlive = 0;
+      for (size_t j = 0; j < numAlive; ++j) {
+        if (loadWord(positions[j].first) & positions[j].second) {
+          alive[stillAlive++] = alive[j];
+        }
+      }
+      numAlive = stillAlive;
+    }
+
+    for (size_t j = 0; j < numAlive; ++j) {
+      out[begin + alive[j]] = true;
+    }
+  }
+}
 
+template <typename T, typename UnderType, typename HashPolicy>
+std::pair<size_t, UnderType>
+BloomRfImpl<T, UnderType, HashPolicy>::hashToIndexAndBitMask(T data,
+                                                             size_t i) const {
+  return wordToIndexAndBitMask(data, i, bloomRFHashToWord(data, i));
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+std::pair<size_t, UnderType>
+BloomRfImpl<T, UnderType, HashPolicy>::wordToIndexAndBitMask(T data,
+                                                             size_t i,
+                                                             size_t pos) const {
   if (1 << (delta[i] - 1) <= 8 * sizeof(UnderType)) {
     // Case 1: Size of PMHF word is less than or equal to the size of the
-    // UnderType.
-    size_t wordsPerUnderType = 8 * sizeof(UnderType) / (1 << (delta[i] - 1));
-    std::ldiv_t div = std::ldiv(pos, wordsPerUnderType);
-    return {div.quot, bloomRFRemainder(data, i, div.rem)};
+    // UnderType.  Both are powers of two, so pos is split with a shift.
+    size_t wordsPerUnderTypeLog = UNDER_TYPE_BITS_LOG<UnderType> - (delta[i] - 1);
+    return {pos >> wordsPerUnderTypeLog,
+            bloomRFRemainder(
+                data, i, pos & ((size_t{1} << wordsPerUnderTypeLog) - 1))};
 
   } else {
     // Case 2: Size of PMHF word is greater than that of the UnderType.
@@ -111,28 +356,34 @@ std::pair<size_t, UnderType> BloomRfImpl<T, UnderType>::hashToIndexAndBitMask(
     UnderType offset =
         ((data >> shifts[i]) & ((UnderType{1} << (delta[i] - 1)) - 1));
     assert(offset < (1 << (delta[i] - 1)));
-    std::ldiv_t div = std::ldiv(offset, 8 * sizeof(UnderType));
-    assert(div.rem < 8 * sizeof(UnderType));
 
-    filterPos += div.quot;
-    return {filterPos, (UnderType{1} << div.rem)};
+    filterPos += offset / (8 * sizeof(UnderType));
+    return {filterPos, (UnderType{1} << (offset % (8 * sizeof(UnderType))))};
   }
 }
 
-template <typename T, typename UnderType>
-bool BloomRfImpl<T, UnderType>::checkDIOfDecomposition(T low,
-                                                       T high,
-                                                       int layer) const {
-  size_t pos = bloomRFHashToWord(low, layer);
+template <typename T, typename UnderType, typename HashPolicy>
+bool BloomRfImpl<T, UnderType, HashPolicy>::checkDIOfDecomposition(
+    T low,
+    T high,
+    int layer) const {
+  return checkDIOfDecomposition(low, high, layer,
+                                bloomRFHashToWord(low, layer));
+}
 
+template <typename T, typename UnderType, typename HashPolicy>
+bool BloomRfImpl<T, UnderType, HashPolicy>::checkDIOfDecomposition(
+    T low,
+    T high,
+    int layer,
+    size_t pos) const {
   if (1 << (delta[layer] - 1) <= 8 * sizeof(UnderType)) {
     // Case 1: Size of PMHF word is less than or equal to the size of the
     // UnderType.
-    size_t wordsPerUnderType =
-        8 * sizeof(UnderType) / (1 << (delta[layer] - 1));
-    std::ldiv_t div = std::ldiv(pos, wordsPerUnderType);
-    UnderType bitmask = buildBitMaskForRange(low, high, layer, div.rem);
-    UnderType word = filter[div.quot];
+    size_t wordsPerUnderTypeLog = UNDER_TYPE_BITS_LOG<UnderType> - (delta[layer] - 1);
+    UnderType bitmask = buildBitMaskForRange(
+        low, high, layer, pos & ((size_t{1} << wordsPerUnderTypeLog) - 1));
+    UnderType word = loadWord(pos >> wordsPerUnderTypeLog);
     if ((bitmask & word) != 0) {
       return true;
     }
@@ -140,15 +391,19 @@ bool BloomRfImpl<T, UnderType>::checkDIOfDecomposition(T low,
     // Case 2: Size of PMHF word is greater than that of the UnderType.
     // In this case we need to iterate over the UnderTypes that comprise the
     // PMHF word.
-    int pmhfWordsPerUT = (1 << (delta[layer] - 1)) / (8 * sizeof(UnderType));
-    int filterPos = pos * pmhfWordsPerUT;
+    size_t pmhfWordsPerUT =
+        (size_t{1} << (delta[layer] - 1)) / (8 * sizeof(UnderType));
+    size_t filterPos = pos * pmhfWordsPerUT;
     UnderType lowOffset =
         ((low >> shifts[layer]) & ((UnderType{1} << (delta[layer] - 1)) - 1));
-    filterPos += (lowOffset / (8 * sizeof(UnderType)));
     UnderType highOffset =
         ((high >> shifts[layer]) & ((UnderType{1} << (delta[layer] - 1)) - 1));
     size_t iters = (highOffset / (8 * sizeof(UnderType))) -
                    (lowOffset / (8 * sizeof(UnderType))) + 1;
+    // Words are read one at a time with loadWord rather than with the SIMD
+    // kernel of anyBitInRange, whose plain vector loads would race with
+    // addConcurrent.  The loop stops at the first set bit.
+    filterPos += (lowOffset / (8 * sizeof(UnderType)));
     for (int i = 0; i < iters; ++i) {
       UnderType bitmask = ~UnderType{0};
       if (i == 0) {
@@ -159,7 +414,7 @@ bool BloomRfImpl<T, UnderType>::checkDIOfDecomposition(T low,
         bitmask &=
             (UnderType{1} << ((highOffset % (8 * sizeof(UnderType))) + 1)) - 1;
       }
-      if ((bitmask & filter[filterPos]) != 0) {
+      if ((bitmask & loadWord(filterPos)) != 0) {
         return true;
       }
       ++filterPos;
@@ -168,94 +423,769 @@ bool BloomRfImpl<T, UnderType>::checkDIOfDecomposition(T low,
   return false;
 }
 
-template <typename T, typename UnderType>
-bool BloomRfImpl<T, UnderType>::findRange(T lkey, T hkey) const {
+template <typename T, typename UnderType, typename HashPolicy>
+bool BloomRfImpl<T, UnderType, HashPolicy>::findRange(T lkey, T hkey) const {
+  return findRangeWithStats<false>(lkey, hkey, nullptr);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+bool BloomRfImpl<T, UnderType, HashPolicy>::findRange(T lkey,
+                                                      T hkey,
+                                                      QueryStats& stats) const {
+  return findRangeWithStats<true>(lkey, hkey, &stats);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+template <bool WithStats>
+bool BloomRfImpl<T, UnderType, HashPolicy>::findRangeWithStats(
+    T lkey,
+    T hkey,
+    QueryStats* stats) const {
   if (lkey > hkey) {
     throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
   }
-  Checks checks(lkey, hkey, {});
+  using Check = typename Checks::Check;
 
-  checks.initChecks(shifts.back(), delta.back());
+  int layer = hashes - 1;
+  // The lowest layer read so far.
+  int lowestLayer = layer;
+  if constexpr (WithStats) {
+    stats->layers.resize(std::max(stats->layers.size(), hashes));
+    ++stats->queries;
+  }
+  auto exit = [&](bool found) {
+    if constexpr (WithStats) {
+      int exitLayer = found ? layer : lowestLayer;
+      stats->lastExitLayer = exitLayer;
+      auto& layerStats = stats->layers[exitLayer];
+      ++(found ? layerStats.positives : layerStats.negatives);
+    }
+    return found;
+  };
 
-  for (int layer = hashes - 1; layer >= 0; --layer) {
-    Checks new_checks(lkey, hkey, {});
-    for (const auto& check : checks.getChecks()) {
-      if (check.low < lkey || check.high > hkey) {
-        auto hash = hashToIndexAndBitMask(check.low, layer);
-        if (filter[hash.first] & hash.second) {
-          Checks check_for_interval{
-              lkey, hkey, {typename Checks::Check{check.low, check.high}}};
-          check_for_interval.advanceChecks(shifts[layer - 1], delta[layer - 1]);
-          new_checks.concatenateChecks(check_for_interval);
-        }
+  BlockCache blockCache(*this);
+  auto checkCovered = [&](const Check& check) {
+    if constexpr (WithStats) {
+      auto& layerStats = stats->layers[layer];
+      ++layerStats.coveredChecks;
+      size_t pmhfBits = size_t{1} << (delta[layer] - 1);
+      if (pmhfBits <= 8 * sizeof(UnderType)) {
+        ++layerStats.words;
       } else {
-        if (checkDIOfDecomposition(check.low, check.high, layer)) {
-          return true;
+        size_t lowOffset = (check.low >> shifts[layer]) & (pmhfBits - 1);
+        size_t highOffset = (check.high >> shifts[layer]) & (pmhfBits - 1);
+        layerStats.words += highOffset / (8 * sizeof(UnderType)) -
+                            lowOffset / (8 * sizeof(UnderType)) + 1;
+      }
+      lowestLayer = layer;
+    }
+    return checkDIOfDecomposition(check.low, check.high, layer,
+                                  blockCache.hashToWord(check.low, layer));
+  };
+
+  Checks checks(lkey, hkey);
+  if (checks.initChecks(shifts.back(), delta.back(), checkCovered)) {
+    return exit(true);
+  }
+
+  // Partial checks have the width of their layer, so none are left once
+  // layer 0 is reached.
+  while (layer > 0 && checks.begin() != checks.end()) {
+    Checks new_checks(lkey, hkey);
+    --layer;
+    for (const auto& check : checks) {
+      if constexpr (WithStats) {
+        ++stats->layers[layer + 1].partialChecks;
+        ++stats->layers[layer + 1].words;
+        lowestLayer = std::min(lowestLayer, layer + 1);
+      }
+      auto hash = wordToIndexAndBitMask(
+          check.low, layer + 1, blockCache.hashToWord(check.low, layer + 1));
+      if ((loadWord(hash.first) & hash.second) &&
+          new_checks.advanceCheck(check, shifts[layer], delta[layer],
+                                  checkCovered)) {
+        return exit(true);
+      }
+    }
+    checks = new_checks;
+  }
+
+  return exit(false);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::findRangeBatch(
+    std::span<const std::pair<T, T>> ranges,
+    bool* out) const {
+  for (const auto& [lkey, hkey] : ranges) {
+    if (lkey > hkey) {
+      throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
+    }
+  }
+
+  std::vector<size_t> order(ranges.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return ranges[a] < ranges[b]; });
+
+  /// A check of one of the queries of the current group, together with the
+  /// PMHF word it probes on its layer.
+  using Check = typename Checks::Check;
+  struct PendingCheck {
+    size_t query;
+    Check check;
+    size_t pos;
+  };
+  std::vector<PendingCheck> current;
+  std::vector<PendingCheck> next;
+
+  // Computes the word a check probes on layer and prefetches it, so that the
+  // load overlaps with the resolution of the checks queued before it.
+  BlockCache blockCache(*this);
+  auto enqueue = [this, &blockCache](std::vector<PendingCheck>& queue,
+                                     size_t query, const Check& check,
+                                     int layer) {
+    size_t pos = blockCache.hashToWord(check.low, layer);
+    __builtin_prefetch(
+        &filter[wordToIndexAndBitMask(check.low, layer, pos).first]);
+    queue.push_back({query, check, pos});
+    return false;
+  };
+
+  // The last partial check probed on each layer and its outcome.  Sorted
+  // neighbouring queries mostly share their dyadic prefixes on the upper
+  // layers, so their boundary checks coincide and are probed only once.
+  std::vector<std::pair<T, bool>> lastProbe(hashes);
+  std::vector<bool> hasLastProbe(hashes, false);
+
+  for (size_t begin = 0; begin < order.size(); begin += BATCH_SIZE) {
+    size_t end = std::min(order.size(), begin + BATCH_SIZE);
+
+    current.clear();
+    for (size_t j = begin; j < end; ++j) {
+      size_t query = order[j];
+      out[query] = false;
+      auto enqueueCovered = [&](const Check& check) {
+        return enqueue(current, query, check, hashes - 1);
+      };
+      Checks checks(ranges[query].first, ranges[query].second);
+      checks.initChecks(shifts.back(), delta.back(), enqueueCovered);
+      for (const auto& check : checks) {
+        enqueue(current, query, check, hashes - 1);
+      }
+    }
+
+    for (int layer = hashes - 1; layer >= 0 && !current.empty(); --layer) {
+      // Children are enqueued (and their words on the next layer prefetched)
+      // while the remaining checks of this layer are still being probed.
+      next.clear();
+      for (const auto& pending : current) {
+        if (out[pending.query]) {
+          continue;
+        }
+        const auto& [lkey, hkey] = ranges[pending.query];
+        const auto& check = pending.check;
+
+        if (check.low < lkey || check.high > hkey) {
+          bool set;
+          if (hasLastProbe[layer] && lastProbe[layer].first == check.low) {
+            set = lastProbe[layer].second;
+          } else {
+            auto hash = wordToIndexAndBitMask(check.low, layer, pending.pos);
+            set = (loadWord(hash.first) & hash.second) != 0;
+            lastProbe[layer] = {check.low, set};
+            hasLastProbe[layer] = true;
+          }
+          if (set) {
+            auto enqueueCovered = [&](const Check& child) {
+              return enqueue(next, pending.query, child, layer - 1);
+            };
+            Checks children(lkey, hkey);
+            children.advanceCheck(check, shifts[layer - 1], delta[layer - 1],
+                                  enqueueCovered);
+            for (const auto& child : children) {
+              enqueue(next, pending.query, child, layer - 1);
+            }
+          }
+        } else if (checkDIOfDecomposition(check.low, check.high, layer,
+                                          pending.pos)) {
+          out[pending.query] = true;
         }
       }
+
+      std::swap(current, next);
     }
+  }
+}
 
-    checks = std::move(new_checks);
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::mergeFrom(
+    const BloomRfImpl& other) {
+  combineWith(other, WordOp::Or);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::intersect(
+    const BloomRfImpl& other) {
+  combineWith(other, WordOp::And);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::combineWith(
+    const BloomRfImpl& other,
+    WordOp op) {
+  // Filters of the same configuration map every key to the same bits.
+  if (!sameConfiguration(other)) {
+    throw std::logic_error{
+        "Only filters with the same configuration can be combined."};
   }
+  combineWords(filter.get(), other.filter.get(), words * sizeof(UnderType),
+               op);
+}
 
-  return false;
+template <typename T, typename UnderType, typename HashPolicy>
+FillEstimate BloomRfImpl<T, UnderType, HashPolicy>::estimateFill() const {
+  auto fillOf = [this](size_t first, size_t n) {
+    return static_cast<double>(
+               countBits(filter.get() + first, n * sizeof(UnderType))) /
+           (8 * sizeof(UnderType) * n);
+  };
+
+  FillEstimate estimate;
+  if (layerWords.empty()) {
+    estimate.fill = fillOf(0, words);
+    estimate.layers.assign(hashes, estimate.fill);
+  } else {
+    size_t first = 0;
+    double bits = 0;
+    for (auto w : layerWords) {
+      estimate.layers.push_back(fillOf(first, w));
+      bits += estimate.layers.back() * w;
+      first += w;
+    }
+    estimate.fill = bits / words;
+  }
+  // Every layer sets one bit per distinct prefix of the key above its shift,
+  // and the prefixes of n uniform keys are distinct with the probability of
+  // the birthday problem.  Filling m bits with s distinct bits leaves
+  // m * exp(-s / m) of them clear, so invert the fill to get the keys.
+  auto distinctBits = [&](double keys) {
+    double bits = 0;
+    for (size_t i = 0; i < hashes; ++i) {
+      double prefixes = std::ldexp(1.0, domain_size - shifts[i]);
+      bits -= prefixes * std::expm1(-keys / prefixes);
+    }
+    return bits;
+  };
+  double observed = 0;
+  for (size_t i = 0; i < hashes; ++i) {
+    size_t layerBits = 8 * sizeof(UnderType) *
+                       (layerWords.empty() ? words : layerWords[i]);
+    double fill = std::min(estimate.layers[i], 1 - 1.0 / layerBits);
+    // Layers that share the filter each account for their share of it.
+    observed -= static_cast<double>(layerBits) * std::log1p(-fill) /
+                (layerWords.empty() ? hashes : 1);
+  }
+  double lowKeys = 0;
+  double highKeys = std::ldexp(1.0, domain_size);
+  for (size_t i = 0; i < 128; ++i) {
+    double mid = (lowKeys + highKeys) / 2;
+    (distinctBits(mid) < observed ? lowKeys : highKeys) = mid;
+  }
+  estimate.keys = lowKeys;
+
+  // An absent key is found if the bit of every layer is set.
+  estimate.pointFpr = std::accumulate(estimate.layers.begin(),
+                                      estimate.layers.end(), 1.0,
+                                      std::multiplies<double>());
+  return estimate;
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+double BloomRfImpl<T, UnderType, HashPolicy>::estimateRangeFpr(T width) const {
+  return estimateRangeFpr(width, estimateFill());
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+double BloomRfImpl<T, UnderType, HashPolicy>::estimateRangeFpr(
+    T width,
+    const FillEstimate& fill) const {
+  if (width == 0) {
+    throw std::logic_error{"Ranges have to hold at least one key."};
+  }
+  if (fill.layers.size() != hashes) {
+    throw std::logic_error{"The fill estimate is of a different filter."};
+  }
+
+  // The decomposition of a range depends on how it is aligned, so average
+  // over ranges at a fixed set of pseudo-random positions.
+  constexpr size_t SAMPLES = 64;
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  auto next = [&state]() {
+    // splitmix64.
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  };
+
+  double total = 0;
+  for (size_t i = 0; i < SAMPLES; ++i) {
+    T low = static_cast<T>(next());
+    if constexpr (sizeof(T) > sizeof(uint64_t)) {
+      low = (low << 64) | next();
+    }
+    T high = low + (width - 1);
+    if (high < low) {
+      high = std::numeric_limits<T>::max();
+      low = high - (width - 1);
+    }
+    total += rangeFprOf(low, high, fill);
+  }
+  return total / SAMPLES;
 }
 
-template <typename T, typename UnderType>
-void BloomRfImpl<T, UnderType>::Checks::advanceChecks(size_t shifts,
-                                                      size_t delta) {
-  T target_width = T{1} << shifts;
-  std::vector<Check> new_checks;
-  assert(checks.size() == 1);
+template <typename T, typename UnderType, typename HashPolicy>
+double BloomRfImpl<T, UnderType, HashPolicy>::rangeFprOf(
+    T low,
+    T high,
+    const FillEstimate& fill) const {
+  using Check = typename Checks::Check;
+
+  // Probability that none of the covered checks so far found a set bit.  A
+  // covered check lies within the empty range, so it only finds bits that
+  // other prefixes collided with, if any of its prefixes has one.
+  double negative = 1;
+  auto visitCovered = [&](size_t layer, double reach) {
+    return [&, layer, reach](const Check& check) {
+      double prefixes =
+          static_cast<double>((check.high - check.low) >> shifts[layer]) + 1;
+      negative *=
+          1 - reach * (1 - std::pow(1 - fill.layers[layer], prefixes));
+      return false;
+    };
+  };
 
+  // A partial check also finds its bit set if a key lies in its part
+  // outside of the range.
+  double keyDensity = fill.keys / std::ldexp(1.0, domain_size);
+  auto passes = [&](const Check& check, size_t layer) {
+    double width = static_cast<double>(check.high - check.low) + 1;
+    double inside =
+        static_cast<double>(std::min(check.high, high) -
+                            std::max(check.low, low)) + 1;
+    double occupied = -std::expm1(-keyDensity * (width - inside));
+    return occupied + (1 - occupied) * fill.layers[layer];
+  };
+
+  Checks checks(low, high);
+  checks.initChecks(shifts.back(), delta.back(),
+                    visitCovered(hashes - 1, 1.0));
+  std::vector<std::pair<Check, double>> partial;
   for (const auto& check : checks) {
-    assert(check.low < lkey || check.high > hkey);
-
-    T bm_for_max = (T{1} << (shifts + delta - 1)) - 1;
-    T lower_limit = (std::max(check.low, lkey) / target_width) * target_width;
-    T upper_limit = (std::min(hkey, check.high) / target_width) * target_width;
-
-    for (T counter = lower_limit;
-         counter <= upper_limit && counter >= lower_limit;) {
-      T curr_high = counter + target_width;
-      if (counter < lkey || curr_high > hkey) {
-        new_checks.push_back({counter, static_cast<T>(curr_high - 1)});
-        counter = curr_high;
-      } else {
-        T next;
-        if (static_cast<T>(counter | bm_for_max) <= upper_limit) {
-          next = static_cast<T>(counter | bm_for_max);
-        } else {
-          next = upper_limit;
-        }
-        new_checks.push_back({counter, next});
-        counter = next + 1;
+    partial.emplace_back(check, 1.0);
+  }
+  for (size_t layer = hashes - 1; layer > 0 && !partial.empty(); --layer) {
+    std::vector<std::pair<Check, double>> next;
+    for (const auto& [check, reach] : partial) {
+      double nextReach = reach * passes(check, layer);
+      Checks newChecks(low, high);
+      newChecks.advanceCheck(check, shifts[layer - 1], delta[layer - 1],
+                             visitCovered(layer - 1, nextReach));
+      for (const auto& newCheck : newChecks) {
+        next.emplace_back(newCheck, nextReach);
       }
     }
+    partial = std::move(next);
   }
-  checks = std::move(new_checks);
+  return 1 - negative;
 }
 
-template <typename T, typename UnderType>
-void BloomRfImpl<T, UnderType>::Checks::initChecks(size_t delta_sum,
-                                                   size_t delta_back) {
-  T low = 0;
-  T high = ~low;
+template <typename T, typename UnderType, typename HashPolicy>
+std::vector<char> BloomRfImpl<T, UnderType, HashPolicy>::serializeHeader(
+    KeyType keyType) const {
+  std::vector<char> header(std::begin(SERIALIZATION_MAGIC),
+                           std::end(SERIALIZATION_MAGIC));
+  appendLittleEndian(header, SERIALIZATION_VERSION);
+  appendLittleEndian(header, static_cast<uint8_t>(keyType));
+  appendLittleEndian(header, static_cast<uint8_t>(sizeof(UnderType)));
+  appendLittleEndian(header, HashPolicy::id);
+  appendLittleEndian(header, static_cast<uint8_t>(hashes));
+  appendLittleEndian(header, static_cast<uint64_t>(seed));
+  appendLittleEndian(header, static_cast<uint64_t>(words));
+  assert(header.size() == SERIALIZATION_FIXED_HEADER_SIZE);
+  for (auto d : delta) {
+    appendLittleEndian(header, static_cast<uint8_t>(d));
+  }
+  appendLittleEndian(header, static_cast<uint8_t>(layout));
+  appendLittleEndian(header, static_cast<uint8_t>(blockedLayers));
+  appendLittleEndian(header, static_cast<uint8_t>(!layerWords.empty()));
+  for (auto w : layerWords) {
+    appendLittleEndian(header, static_cast<uint64_t>(w));
+  }
+  appendLittleEndian(header, static_cast<uint8_t>(reduction));
+  while (header.size() % SERIALIZATION_WORDS_ALIGNMENT != 0) {
+    header.push_back(0);
+  }
+  return header;
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+uint64_t BloomRfImpl<T, UnderType, HashPolicy>::checksum(
+    std::span<const char> header) const {
+  uint64_t wordsHash;
+  if constexpr (std::endian::native == std::endian::little) {
+    wordsHash = CityHash64(reinterpret_cast<const char*>(filter.get()),
+                           words * sizeof(UnderType));
+  } else {
+    std::vector<UnderType> littleEndian(filter.get(), filter.get() + words);
+    wordsToFromLittleEndian(littleEndian.data(), words);
+    wordsHash = CityHash64(reinterpret_cast<const char*>(littleEndian.data()),
+                           words * sizeof(UnderType));
+  }
+  return Hash128to64(
+      uint128{CityHash64(header.data(), header.size()), wordsHash});
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+void BloomRfImpl<T, UnderType, HashPolicy>::serialize(std::ostream& out,
+                                                      KeyType keyType) const {
+  std::vector<char> header = serializeHeader(keyType);
+  out.write(header.data(), header.size());
+
+  if constexpr (std::endian::native == std::endian::little) {
+    out.write(reinterpret_cast<const char*>(filter.get()),
+              words * sizeof(UnderType));
+  } else {
+    std::vector<UnderType> littleEndian(filter.get(), filter.get() + words);
+    wordsToFromLittleEndian(littleEndian.data(), words);
+    out.write(reinterpret_cast<const char*>(littleEndian.data()),
+              words * sizeof(UnderType));
+  }
+
+  std::vector<char> trailer;
+  appendLittleEndian(trailer, checksum(header));
+  out.write(trailer.data(), trailer.size());
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+std::vector<char> BloomRfImpl<T, UnderType, HashPolicy>::serialize(
+    KeyType keyType) const {
+  std::vector<char> header = serializeHeader(keyType);
+  std::vector<char> out = header;
+  out.reserve(header.size() + words * sizeof(UnderType) + sizeof(uint64_t));
+  if constexpr (std::endian::native == std::endian::little) {
+    const char* bytes = reinterpret_cast<const char*>(filter.get());
+    out.insert(out.end(), bytes, bytes + words * sizeof(UnderType));
+  } else {
+    for (size_t i = 0; i < words; ++i) {
+      appendLittleEndian(out, filter[i]);
+    }
+  }
+  appendLittleEndian(out, checksum(header));
+  return out;
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+template <typename Read>
+BloomFilterRFParameters BloomRfImpl<T, UnderType, HashPolicy>::readHeader(
+    Read read,
+    KeyType keyType,
+    std::vector<char>& header) {
+  header.resize(SERIALIZATION_FIXED_HEADER_SIZE);
+  read(header.data(), header.size());
+
+  if (!std::equal(std::begin(SERIALIZATION_MAGIC),
+                  std::end(SERIALIZATION_MAGIC), header.begin())) {
+    throw std::runtime_error{"Input is not a serialized bloomRF filter."};
+  }
+  uint32_t version = loadLittleEndian<uint32_t>(&header[4]);
+  if (version == 0 || version > SERIALIZATION_VERSION) {
+    throw std::runtime_error{"Unsupported bloomRF serialization version."};
+  }
+  if (loadLittleEndian<uint8_t>(&header[8]) != static_cast<uint8_t>(keyType)) {
+    throw std::runtime_error{"Serialized filter has a different key type."};
+  }
+  if (loadLittleEndian<uint8_t>(&header[9]) != sizeof(UnderType)) {
+    throw std::runtime_error{"Serialized filter has a different UnderType."};
+  }
+  if (loadLittleEndian<uint8_t>(&header[10]) != HashPolicy::id) {
+    throw std::runtime_error{
+        "Serialized filter has a different hash policy."};
+  }
+  size_t layers = loadLittleEndian<uint8_t>(&header[11]);
+  if (layers == 0) {
+    throw std::runtime_error{"Serialized filter has no layers."};
+  }
+  size_t seed = loadLittleEndian<uint64_t>(&header[12]);
+  size_t words = loadLittleEndian<uint64_t>(&header[20]);
+  if (words == 0 || words > std::numeric_limits<size_t>::max() /
+                                sizeof(UnderType)) {
+    throw std::runtime_error{"Serialized filter has an invalid size."};
+  }
+
+  // Reads the next n bytes of the header.
+  auto readMore = [&read, &header](size_t n) {
+    header.resize(header.size() + n);
+    read(header.data() + header.size() - n, n);
+  };
+
+  size_t options = SERIALIZATION_FIXED_HEADER_SIZE + layers;
+  readMore(layers + (version >= 3 ? 2 : 0) + (version >= 4 ? 1 : 0));
+  std::vector<size_t> delta(
+      header.begin() + SERIALIZATION_FIXED_HEADER_SIZE,
+      header.begin() + SERIALIZATION_FIXED_HEADER_SIZE + layers);
+  if (std::find(delta.begin(), delta.end(), 0) != delta.end() ||
+      std::accumulate(delta.begin(), delta.end(), size_t{0}) > 8 * sizeof(T)) {
+    throw std::runtime_error{"Serialized filter has an invalid delta vector."};
+  }
+  // Every layer hashes to at least one PMHF word.  Sub-arrays are checked
+  // against the widest one below.
+  for (auto d : delta) {
+    if (d - 1 >= 8 * sizeof(size_t) ||
+        (size_t{1} << (d - 1)) / (8 * sizeof(UnderType)) > words) {
+      throw std::runtime_error{
+          "Serialized filter is smaller than a PMHF word of a layer."};
+    }
+  }
+
+  Layout layout = Layout::Flat;
+  size_t blockedLayers = 0;
+  if (version >= 3) {
+    uint8_t layoutId = loadLittleEndian<uint8_t>(&header[options]);
+    blockedLayers = loadLittleEndian<uint8_t>(&header[options + 1]);
+    if (layoutId > static_cast<uint8_t>(Layout::Blocked)) {
+      throw std::runtime_error{"Serialized filter has an unknown layout."};
+    }
+    layout = static_cast<Layout>(layoutId);
+    // A blocked filter is stored with its final, block aligned size.
+    if (layout == Layout::Blocked &&
+        (blockedLayers == 0 || blockedLayers > layers ||
+         words * sizeof(UnderType) % detail::FILTER_ALIGNMENT != 0)) {
+      throw std::runtime_error{"Serialized filter has an invalid layout."};
+    }
+  }
+
+  std::vector<size_t> layerSizes;
+  if (version >= 4 && loadLittleEndian<uint8_t>(&header[options + 2])) {
+    size_t first = header.size();
+    readMore(layers * sizeof(uint64_t));
+    size_t sum = 0;
+    for (size_t i = 0; i < layers; ++i) {
+      uint64_t layerWords = loadLittleEndian<uint64_t>(
+          &header[first + i * sizeof(uint64_t)]);
+      if (layerWords == 0 || layerWords > words) {
+        throw std::runtime_error{"Serialized filter has an invalid layout."};
+      }
+      sum += layerWords;
+      layerSizes.push_back(layerWords * sizeof(UnderType));
+    }
+    if (sum != words) {
+      throw std::runtime_error{"Serialized filter has an invalid layout."};
+    }
+  }
+
+  IndexReduction reduction = IndexReduction::Modulo;
+  if (version >= 5) {
+    readMore(1);
+    uint8_t reductionId = loadLittleEndian<uint8_t>(&header.back());
+    if (reductionId > static_cast<uint8_t>(IndexReduction::PowerOfTwo)) {
+      throw std::runtime_error{
+          "Serialized filter has an unknown index reduction."};
+    }
+    reduction = static_cast<IndexReduction>(reductionId);
+  }
+
+  // The constructor rounds sizes up, so only sizes that it leaves as they
+  // are can be valid.  Checking them here keeps it from allocating anything
+  // else.
+  bool powerOfTwo = reduction == IndexReduction::PowerOfTwo;
+  size_t alignment = layerAlignment<UnderType>(delta);
+  for (size_t size : layerSizes) {
+    size_t layerWords = size / sizeof(UnderType);
+    if (layerWords % alignment != 0 ||
+        (powerOfTwo && !std::has_single_bit(layerWords))) {
+      throw std::runtime_error{"Serialized filter has an invalid layout."};
+    }
+  }
+  if (layerSizes.empty() && powerOfTwo && !std::has_single_bit(words)) {
+    throw std::runtime_error{"Serialized filter has an invalid layout."};
+  }
+
+  if (version >= 2) {
+    readMore((SERIALIZATION_WORDS_ALIGNMENT -
+              header.size() % SERIALIZATION_WORDS_ALIGNMENT) %
+             SERIALIZATION_WORDS_ALIGNMENT);
+  }
+
+  return BloomFilterRFParameters{words * sizeof(UnderType), seed,
+                                 std::move(delta),
+                                 layout,
+                                 blockedLayers,
+                                 std::move(layerSizes),
+                                 reduction};
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::fromSerialized(
+    const BloomFilterRFParameters& params,
+    Container filter_) {
+  try {
+    return BloomRfImpl{params, std::move(filter_)};
+  } catch (const std::logic_error& e) {
+    throw std::runtime_error{
+        std::string{"Serialized filter has invalid parameters: "} + e.what()};
+  }
+}
 
-  if (checks.size() > 0) {
+template <typename T, typename UnderType, typename HashPolicy>
+template <typename Read, typename Remaining>
+BloomRfImpl<T, UnderType, HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::deserializeFrom(Read read,
+                                                       Remaining remaining,
+                                                       KeyType keyType) {
+  std::vector<char> header;
+  BloomFilterRFParameters params = readHeader(read, keyType, header);
+
+  // The size in the header is not trusted until the words have arrived.  If
+  // the input size is known, it has to hold them.  Otherwise they are read
+  // in bounded chunks first, so that a corrupt size fails as truncated
+  // instead of allocating it.
+  std::vector<char> buffered;
+  if (std::optional<size_t> left = remaining()) {
+    if (*left < params.filter_size + sizeof(uint64_t)) {
+      throw std::runtime_error{"Serialized filter is truncated."};
+    }
+  } else {
+    constexpr size_t CHUNK_BYTES = size_t{1} << 20;
+    for (size_t done = 0; done < params.filter_size; done += CHUNK_BYTES) {
+      size_t n = std::min(CHUNK_BYTES, params.filter_size - done);
+      buffered.resize(done + n);
+      read(buffered.data() + done, n);
+    }
+  }
+
+  BloomRfImpl impl = fromSerialized(params, nullptr);
+  // The words of a valid filter are stored with their rounded sizes.
+  if (impl.words * sizeof(UnderType) != params.filter_size) {
+    throw std::runtime_error{"Serialized filter has an invalid layout."};
+  }
+  if (buffered.empty()) {
+    read(reinterpret_cast<char*>(impl.filter.get()),
+         impl.words * sizeof(UnderType));
+  } else {
+    std::copy(buffered.begin(), buffered.end(),
+              reinterpret_cast<char*>(impl.filter.get()));
+  }
+  wordsToFromLittleEndian(impl.filter.get(), impl.words);
+
+  char trailer[sizeof(uint64_t)];
+  read(trailer, sizeof(trailer));
+  if (loadLittleEndian<uint64_t>(trailer) != impl.checksum(header)) {
+    throw std::runtime_error{"Serialized filter is corrupt."};
+  }
+  return impl;
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::deserialize(std::istream& in,
+                                                   KeyType keyType) {
+  return deserializeFrom(
+      [&in](char* dst, size_t n) {
+        if (!in.read(dst, n)) {
+          throw std::runtime_error{"Serialized filter is truncated."};
+        }
+      },
+      [&in]() -> std::optional<size_t> {
+        // Only seekable streams know how much is left.
+        std::istream::pos_type pos = in.tellg();
+        if (pos == std::istream::pos_type(-1)) {
+          return std::nullopt;
+        }
+        in.seekg(0, std::ios::end);
+        std::istream::pos_type end = in.tellg();
+        in.clear();
+        in.seekg(pos);
+        if (end == std::istream::pos_type(-1)) {
+          return std::nullopt;
+        }
+        return static_cast<size_t>(end - pos);
+      },
+      keyType);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::deserialize(std::span<const char> buffer,
+                                                   KeyType keyType) {
+  return deserializeFrom(
+      [&buffer](char* dst, size_t n) {
+        if (n > buffer.size()) {
+          throw std::runtime_error{"Serialized filter is truncated."};
+        }
+        std::copy_n(buffer.begin(), n, dst);
+        buffer = buffer.subspan(n);
+      },
+      [&buffer]() -> std::optional<size_t> { return buffer.size(); },
+      keyType);
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::view(std::span<const char> buffer,
+                                            KeyType keyType,
+                                            bool verifyChecksum) {
+  if constexpr (std::endian::native != std::endian::little) {
+    throw std::logic_error{
+        "Serialized words can only be used in place on little-endian "
+        "platforms."};
+  }
+
+  std::vector<char> header;
+  std::span<const char> rest = buffer;
+  BloomFilterRFParameters params = readHeader(
+      [&rest](char* dst, size_t n) {
+        if (n > rest.size()) {
+          throw std::runtime_error{"Serialized filter is truncated."};
+        }
+        std::copy_n(rest.begin(), n, dst);
+        rest = rest.subspan(n);
+      },
+      keyType, header);
+
+  size_t wordBytes = params.filter_size;
+  if (rest.size() < wordBytes + sizeof(uint64_t)) {
+    throw std::runtime_error{"Serialized filter is truncated."};
+  }
+  if (reinterpret_cast<uintptr_t>(rest.data()) % alignof(UnderType) != 0) {
     throw std::logic_error{
-        "Cannot init checks on a non-empty checks instance."};
+        "Words of a viewed filter must be aligned for UnderType."};
+  }
+
+  // The view never writes through the container.
+  auto* words = reinterpret_cast<UnderType*>(const_cast<char*>(rest.data()));
+  BloomRfImpl impl = fromSerialized(
+      params, Container(words, FilterDeleter<UnderType>{false}));
+  // The sub-arrays of a valid filter are stored with their rounded sizes.
+  if (impl.words * sizeof(UnderType) != wordBytes) {
+    throw std::runtime_error{"Serialized filter has an invalid layout."};
   }
 
-  checks.push_back({low, high});
-  advanceChecks(delta_sum, delta_back);
+  if (verifyChecksum && loadLittleEndian<uint64_t>(rest.data() + wordBytes) !=
+                            impl.checksum(header)) {
+    throw std::runtime_error{"Serialized filter is corrupt."};
+  }
+  return impl;
 }
 
-template <typename T, typename UnderType>
-UnderType BloomRfImpl<T, UnderType>::buildBitMaskForRange(T low,
-                                                          T high,
-                                                          size_t i,
-                                                          int wordPos) const {
+template <typename T, typename UnderType, typename HashPolicy>
+UnderType BloomRfImpl<T, UnderType, HashPolicy>::buildBitMaskForRange(
+    T low,
+    T high,
+    size_t i,
+    int wordPos) const {
   UnderType lowOffset = ((low >> shifts[i]) & ((1 << (delta[i] - 1)) - 1));
   UnderType highOffset = ((high >> shifts[i]) & ((1 << (delta[i] - 1)) - 1));
   UnderType bitmask = ~UnderType{0};
@@ -267,16 +1197,21 @@ UnderType BloomRfImpl<T, UnderType>::buildBitMaskForRange(T low,
   return bitmask;
 }
 
-template <typename T, typename UnderType>
-BloomRfImpl<T, UnderType>::BloomRfImpl(size_t size_,
-                                       size_t seed_,
-                                       std::vector<size_t> delta_)
-    : hashes(delta_.size()),
-      seed(seed_),
-      words((size_ + sizeof(UnderType) - 1) / sizeof(UnderType)),
-      filter(new UnderType[words]{}),
-      delta(delta_),
-      shifts(delta.size()) {
+template <typename T, typename UnderType, typename HashPolicy>
+BloomRfImpl<T, UnderType, HashPolicy>::BloomRfImpl(
+    const BloomFilterRFParameters& params,
+    Container filter_)
+    : hashes(params.delta.size()),
+      seed(params.seed),
+      words((params.filter_size + sizeof(UnderType) - 1) / sizeof(UnderType)),
+      layout(params.layout),
+      reduction(params.reduction),
+      blockedLayers(0),
+      blocks(0),
+      blockShift(0),
+      delta(params.delta),
+      shifts(delta.size()),
+      filter(std::move(filter_)) {
   if (delta.empty()) {
     throw std::logic_error{"Delta vector cannot be empty."};
   }
@@ -292,16 +1227,145 @@ BloomRfImpl<T, UnderType>::BloomRfImpl(size_t size_,
     }
   }
 
+  if (reduction > IndexReduction::PowerOfTwo) {
+    throw std::logic_error{"Unknown index reduction."};
+  }
+  bool powerOfTwo = reduction == IndexReduction::PowerOfTwo;
+
   /// Compute prefix sums.
   for (int i = 1; i < delta.size(); ++i) {
     shifts[i] = shifts[i - 1] + delta[i - 1];
   }
+
+  if (layout == Layout::Blocked) {
+    // Round the filter up to whole blocks.
+    size_t wordsPerBlock = BLOCK_BITS / (8 * sizeof(UnderType));
+    blocks = (words + wordsPerBlock - 1) / wordsPerBlock;
+    if (powerOfTwo) {
+      blocks = std::bit_ceil(blocks);
+    }
+    words = blocks * wordsPerBlock;
+
+    auto prefixes = [this](size_t i) -> size_t {
+      size_t prefixBits = domain_size - (shifts[i] + delta[i] - 1);
+      return prefixBits < 64 ? size_t{1} << prefixBits
+                             : std::numeric_limits<size_t>::max();
+    };
+    auto fitsBlock = [this](size_t i) {
+      return (size_t{1} << (delta[i] - 1)) <= BLOCK_BITS;
+    };
+
+    if (params.blocked_layers == 0) {
+      blockedLayers = 0;
+      while (blockedLayers < hashes && fitsBlock(blockedLayers) &&
+             prefixes(blockedLayers) / MIN_PREFIXES_PER_BLOCK >= blocks) {
+        ++blockedLayers;
+      }
+      if (blockedLayers == 0) {
+        throw std::logic_error{
+            "Keys have too few prefixes for the blocked layout."};
+      }
+    } else {
+      blockedLayers = params.blocked_layers;
+      if (blockedLayers > hashes) {
+        throw std::logic_error{"Cannot block more layers than there are."};
+      }
+      for (size_t i = 0; i < blockedLayers; ++i) {
+        if (!fitsBlock(i)) {
+          throw std::logic_error{
+              "PMHF words of blocked layers cannot exceed a block."};
+        }
+      }
+      if (prefixes(blockedLayers - 1) < blocks) {
+        throw std::logic_error{
+            "Blocked layout needs at least as many key prefixes as blocks."};
+      }
+    }
+
+    size_t top = blockedLayers - 1;
+    blockShift = shifts[top] + delta[top] - 1;
+  } else if (layout != Layout::Flat) {
+    throw std::logic_error{"Unknown layout."};
+  }
+
+  if (!params.layer_sizes.empty()) {
+    if (layout != Layout::Flat) {
+      throw std::logic_error{
+          "Layer sizes cannot be combined with the blocked layout."};
+    }
+    if (params.layer_sizes.size() != hashes) {
+      throw std::logic_error{"There has to be one layer size per layer."};
+    }
+    if (std::accumulate(params.layer_sizes.begin(), params.layer_sizes.end(),
+                        size_t{0}) != params.filter_size) {
+      throw std::logic_error{"Layer sizes must add up to the filter size."};
+    }
+
+    // Round every sub-array up to whole cache lines and whole PMHF words of
+    // any layer, so that all of them start aligned.  A layer has to hold the
+    // widest PMHF word, so that rounding never more than doubles it.
+    size_t alignment = layerAlignment<UnderType>(delta);
+    size_t lineWords = FILTER_ALIGNMENT / sizeof(UnderType);
+    words = 0;
+    for (auto size : params.layer_sizes) {
+      if (size == 0) {
+        throw std::logic_error{"The size of a layer cannot be zero."};
+      }
+      size_t w = (size + sizeof(UnderType) - 1) / sizeof(UnderType);
+      w = (w + lineWords - 1) / lineWords * lineWords;
+      if (alignment > w) {
+        throw std::logic_error{
+            "Every layer size has to hold a PMHF word of every layer."};
+      }
+      w = (w + alignment - 1) / alignment * alignment;
+      // A power of two that is at least the alignment stays aligned.
+      layerWords.push_back(powerOfTwo ? std::bit_ceil(w) : w);
+      words += layerWords.back();
+    }
+  } else if (powerOfTwo) {
+    // Blocked filters have a power of two of blocks already.
+    words = std::bit_ceil(words);
+  }
+
+  layerFirstPmhfWord.resize(hashes);
+  layerPmhfWords.resize(hashes);
+  size_t firstWord = 0;
+  for (size_t i = 0; i < hashes; ++i) {
+    size_t bits = 8 * sizeof(UnderType) *
+                  (layerWords.empty() ? words : layerWords[i]);
+    if (delta[i] - 1 >= 8 * sizeof(size_t) || (bits >> (delta[i] - 1)) == 0) {
+      throw std::logic_error{
+          "The filter cannot be smaller than a PMHF word of a layer."};
+    }
+    layerFirstPmhfWord[i] =
+        (8 * sizeof(UnderType) * firstWord) >> (delta[i] - 1);
+    layerPmhfWords[i] = bits >> (delta[i] - 1);
+    if (!layerWords.empty()) {
+      firstWord += layerWords[i];
+    }
+  }
+
+  if (!filter) {
+    filter = allocateWords<UnderType>(words, params.memory);
+  }
 }
 
 template class BloomRfImpl<uint16_t>;
 template class BloomRfImpl<uint32_t>;
 template class BloomRfImpl<uint64_t>;
 template class BloomRfImpl<uint64_t, uint32_t>;
+template class BloomRfImpl<unsigned __int128>;
+
+template class BloomRfImpl<uint16_t, uint64_t, City128HashPolicy>;
+template class BloomRfImpl<uint32_t, uint64_t, City128HashPolicy>;
+template class BloomRfImpl<uint64_t, uint64_t, City128HashPolicy>;
+template class BloomRfImpl<unsigned __int128, uint64_t, City128HashPolicy>;
+template class BloomRfImpl<uint64_t, uint32_t, City128HashPolicy>;
+
+template class BloomRfImpl<uint16_t, uint64_t, MixHashPolicy>;
+template class BloomRfImpl<uint32_t, uint64_t, MixHashPolicy>;
+template class BloomRfImpl<uint64_t, uint64_t, MixHashPolicy>;
+template class BloomRfImpl<uint64_t, uint32_t, MixHashPolicy>;
 
 }  // namespace detail
 
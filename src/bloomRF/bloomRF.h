@@ -1,23 +1,61 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bit>
+#include <cassert>
 #include <cstddef>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include <bit>
 #include <cstring>
 
+#include "bitRange.h"
 #include "city/city.h"
+#include "filterMemory.h"
 
 namespace filters {
 
+/// How the PMHF words of the layers are placed in the filter.
+enum class Layout : uint8_t {
+  /// Every layer hashes into the whole filter, so a point lookup touches one
+  /// cache line per layer.
+  Flat = 0,
+  /// The lower layers of a key share one 64-byte block, selected by the
+  /// prefix that the highest of them hashes.  A point lookup then touches a
+  /// single cache line for all of those layers.  Keys have to be spread over
+  /// that prefix, or they crowd into a few blocks.
+  Blocked = 1,
+};
+
+/// How a hash is reduced to one of the n PMHF words of a layer.
+enum class IndexReduction : uint8_t {
+  /// hash % n, a 64-bit division per layer and probe.
+  Modulo = 0,
+  /// (hash * n) >> 64 (Lemire's fast range), a multiplication instead.
+  MultiplyShift = 1,
+  /// hash & (n - 1).  The filter, and each sub-array or the number of blocks,
+  /// is rounded up to a power of two, so it may take up to twice the memory.
+  PowerOfTwo = 2,
+};
+
 struct BloomFilterRFParameters {
   BloomFilterRFParameters(size_t filter_size_,
                           size_t seed_,
-                          std::vector<size_t> delta_);
+                          std::vector<size_t> delta_,
+                          Layout layout_ = Layout::Flat,
+                          size_t blocked_layers_ = 0,
+                          std::vector<size_t> layer_sizes_ = {},
+                          IndexReduction reduction_ = IndexReduction::Modulo);
 
   /// size of filter in bytes.
   size_t filter_size;
@@ -25,88 +63,656 @@ struct BloomFilterRFParameters {
   size_t seed;
   /// Distance between layers.
   std::vector<size_t> delta;
+  /// Placement of the PMHF words.
+  Layout layout;
+  /// Number of layers, counted from the lowest one, that share a block in
+  /// the blocked layout.  The layers above are hashed over the whole filter
+  /// as in the flat layout.  0 blocks every layer whose key prefixes
+  /// outnumber the blocks 64 times, so that uniform keys fill the blocks
+  /// evenly.
+  size_t blocked_layers;
+  /// Size in bytes of the sub-array of each layer, which then only hashes
+  /// into its own sub-array (section 7 of the paper).  The sizes have to add
+  /// up to filter_size, and each is rounded up to whole cache lines and
+  /// whole PMHF words of any layer.  A size that rounds up to less than the
+  /// widest PMHF word throws std::logic_error.  Empty
+  /// lets all layers share the whole filter.  Not supported by the blocked
+  /// layout.
+  std::vector<size_t> layer_sizes;
+  /// Reduction of hashes to PMHF words.
+  IndexReduction reduction;
+  /// Pages and NUMA placement of the words.  Not serialized.
+  MemoryPolicy memory;
+};
+
+/// Counters of the work that findRange(lkey, hkey, stats) did, per layer
+/// with the lowest layer first.  Counters are added to, so one instance can
+/// aggregate many queries, e.g. to tune the delta vector from a trace.
+struct QueryStats {
+  struct Layer {
+    /// Probes of intervals that straddle lkey or hkey.
+    uint64_t partialChecks = 0;
+    /// Dyadic intervals within [lkey, hkey] that were tested.
+    uint64_t coveredChecks = 0;
+    /// UnderType words read.
+    uint64_t words = 0;
+    /// Queries that found a set bit in a covered interval of this layer.
+    uint64_t positives = 0;
+    /// Queries that came back empty with this as the lowest layer read.
+    uint64_t negatives = 0;
+    /// Positives that recordFalsePositive marked as false.
+    uint64_t falsePositives = 0;
+  };
+
+  std::vector<Layer> layers;
+  uint64_t queries = 0;
+  /// The layer that decided the last query.
+  size_t lastExitLayer = 0;
+
+  /// Attributes the last query, which returned true although no key lies in
+  /// its range, to the layer that let it through.  Throws std::logic_error
+  /// if no query was recorded.
+  void recordFalsePositive() {
+    if (queries == 0) {
+      throw std::logic_error{"No query to record a false positive for."};
+    }
+    layers.resize(std::max(layers.size(), lastExitLayer + 1));
+    ++layers[lastExitLayer].falsePositives;
+  }
+
+  QueryStats& operator+=(const QueryStats& other) {
+    layers.resize(std::max(layers.size(), other.layers.size()));
+    for (size_t i = 0; i < other.layers.size(); ++i) {
+      layers[i].partialChecks += other.layers[i].partialChecks;
+      layers[i].coveredChecks += other.layers[i].coveredChecks;
+      layers[i].words += other.layers[i].words;
+      layers[i].positives += other.layers[i].positives;
+      layers[i].negatives += other.layers[i].negatives;
+      layers[i].falsePositives += other.layers[i].falsePositives;
+    }
+    queries += other.queries;
+    lastExitLayer = other.lastExitLayer;
+    return *this;
+  }
+};
+
+/// How saturated a filter is, from a popcount of its words.  The estimates
+/// assume that absent keys are spread over the domain independently of the
+/// keys that were added.
+struct FillEstimate {
+  /// Fraction of set bits of the whole filter.
+  double fill = 0;
+  /// Fraction of set bits among those that each layer probes, lowest layer
+  /// first.  Layers that share the filter all see its fill.
+  std::vector<double> layers;
+  /// Estimated number of distinct keys that were added.
+  double keys = 0;
+  /// Estimated false positive rate of find.
+  double pointFpr = 0;
 };
 
+struct CityHashPolicy;
+
+template <typename Key,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy>
+class BloomRFView;
+
+template <typename Key,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy>
+class CountingBloomRF;
+
+template <typename Key,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy>
+class ScalableBloomRF;
+
+template <typename Key,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy>
+class BloomRFShardSet;
+
 namespace detail {
 
-template <typename T, typename UnderType = uint64_t>
+constexpr uint64_t SEED_GEN_A = 845897321;
+constexpr uint64_t SEED_GEN_B = 217728422;
+
+}  // namespace detail
+
+//
+// Hash policies.  Every layer of the filter hashes a different prefix of the
+// key, so a policy maps a (prefix, seed, layer) triple to a 64-bit hash.
+//
+
+/// Two CityHash64 evaluations per layer, combined by double hashing.
+struct CityHashPolicy {
+  /// Identifies the policy in serialized filters.
+  static constexpr uint8_t id = 0;
+
+  template <typename T>
+  static uint64_t hash(T data, uint64_t seed, size_t i) {
+    uint64_t hash1 = CityHash64WithSeed(reinterpret_cast<const char*>(&data),
+                                        sizeof(data), seed);
+    uint64_t hash2 = CityHash64WithSeed(
+        reinterpret_cast<const char*>(&data), sizeof(data),
+        detail::SEED_GEN_A * seed + detail::SEED_GEN_B);
+    return hash1 + i * hash2 + i * i;
+  }
+};
+
+/// A single CityHash128 evaluation per layer whose halves are combined by
+/// double hashing.
+struct City128HashPolicy {
+  static constexpr uint8_t id = 1;
+
+  template <typename T>
+  static uint64_t hash(T data, uint64_t seed, size_t i) {
+    uint128 hash = CityHash128WithSeed(
+        reinterpret_cast<const char*>(&data), sizeof(data),
+        uint128{seed, detail::SEED_GEN_A * seed + detail::SEED_GEN_B});
+    return Uint128Low64(hash) + i * Uint128High64(hash) + i * i;
+  }
+};
+
+/// A multiply-xorshift mixer (the murmur3 finalizer) for fixed-width integer
+/// keys.  Much cheaper than CityHash, at the price of weaker guarantees for
+/// adversarial keys.
+struct MixHashPolicy {
+  static constexpr uint8_t id = 2;
+
+  template <typename T>
+  static uint64_t hash(T data, uint64_t seed, size_t i) {
+    static_assert(sizeof(T) <= sizeof(uint64_t));
+    uint64_t x = static_cast<uint64_t>(data) ^
+                 (seed + (i + 1) * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+  }
+};
+
+/// Key type recorded in serialized filters, so that a filter is never read
+/// back with a different key type than it was written with.
+enum class KeyType : uint8_t {
+  UInt16 = 0,
+  UInt32 = 1,
+  UInt64 = 2,
+  Int16 = 3,
+  Int32 = 4,
+  Int64 = 5,
+  Float = 6,
+  Double = 7,
+  UInt128 = 8,
+};
+
+namespace detail {
+
+template <typename Key>
+constexpr KeyType keyTypeOf() {
+  if constexpr (std::is_same_v<Key, uint16_t>) {
+    return KeyType::UInt16;
+  } else if constexpr (std::is_same_v<Key, uint32_t>) {
+    return KeyType::UInt32;
+  } else if constexpr (std::is_same_v<Key, uint64_t>) {
+    return KeyType::UInt64;
+  } else if constexpr (std::is_same_v<Key, unsigned __int128>) {
+    return KeyType::UInt128;
+  } else if constexpr (std::is_same_v<Key, int16_t>) {
+    return KeyType::Int16;
+  } else if constexpr (std::is_same_v<Key, int32_t>) {
+    return KeyType::Int32;
+  } else if constexpr (std::is_same_v<Key, int64_t>) {
+    return KeyType::Int64;
+  } else if constexpr (std::is_same_v<Key, float>) {
+    return KeyType::Float;
+  } else {
+    static_assert(std::is_same_v<Key, double>,
+                  "Key type cannot be serialized.");
+    return KeyType::Double;
+  }
+}
+
+/// Whether T can be the key type of BloomRfImpl.  std::is_unsigned does not
+/// hold for unsigned __int128 in strict ISO mode.
+template <typename T>
+constexpr bool isUnsignedKey =
+    std::is_unsigned_v<T> || std::is_same_v<T, unsigned __int128>;
+
+/// Alignment of the words of a filter, so that the blocks of the blocked
+/// layout are cache lines.
+constexpr size_t FILTER_ALIGNMENT = 64;
+
+/// Frees the words of a filter, unless the filter only borrows them.
+template <typename UnderType>
+struct FilterDeleter {
+  bool owned = true;
+  /// Length of the mapping of the words, or 0 if they came from operator
+  /// new.
+  size_t mappedBytes = 0;
+
+  void operator()(UnderType* words) const {
+    if (!owned) {
+      return;
+    }
+    if (mappedBytes != 0) {
+      unmapWords(words, mappedBytes);
+    } else {
+      ::operator delete[](words, std::align_val_t{FILTER_ALIGNMENT});
+    }
+  }
+};
+
+/// Allocates words zeroed UnderTypes as selected by policy.
+template <typename UnderType>
+std::unique_ptr<UnderType[], FilterDeleter<UnderType>> allocateWords(
+    size_t words,
+    const MemoryPolicy& policy) {
+  if (policy.pages == Pages::Default &&
+      policy.numa == NumaPlacement::FirstTouch && policy.nodes.empty()) {
+    return std::unique_ptr<UnderType[], FilterDeleter<UnderType>>(
+        new (std::align_val_t{FILTER_ALIGNMENT}) UnderType[words]{});
+  }
+  size_t length = 0;
+  void* mapped = mapWords(words * sizeof(UnderType), policy, length);
+  return std::unique_ptr<UnderType[], FilterDeleter<UnderType>>(
+      static_cast<UnderType*>(mapped), FilterDeleter<UnderType>{true, length});
+}
+
+/// Number of keys that the batch APIs hash and prefetch together.
+constexpr size_t BATCH_SIZE = 64;
+
+/// Converts keys to their unsigned representation one block at a time and
+/// hands each block, together with its offset in keys, to fn.
+template <typename UnsignedKey, typename Key, typename Convert, typename Fn>
+void forEachConvertedBlock(std::span<const Key> keys, Convert convert, Fn fn) {
+  std::array<UnsignedKey, BATCH_SIZE> block;
+  for (size_t begin = 0; begin < keys.size(); begin += BATCH_SIZE) {
+    size_t n = std::min(BATCH_SIZE, keys.size() - begin);
+    std::transform(keys.begin() + begin, keys.begin() + begin + n,
+                   block.begin(), convert);
+    fn(std::span<const UnsignedKey>(block.data(), n), begin);
+  }
+}
+
+/// Number of threads that addBatchParallel uses by default.
+inline size_t defaultThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/// Fewest keys for which addBatchParallel starts another thread.
+constexpr size_t PARALLEL_MIN_KEYS = 1 << 16;
+
+/// Splits [0, n) into at most threads contiguous slices of at least
+/// PARALLEL_MIN_KEYS each and calls fn(begin, end) for every slice on its own
+/// thread.  The first slice runs on the calling thread.
+template <typename Fn>
+void forEachSliceInParallel(size_t n, size_t threads, Fn fn) {
+  if (threads == 0) {
+    throw std::logic_error{"Cannot add keys with zero threads."};
+  }
+  threads = std::clamp<size_t>(n / PARALLEL_MIN_KEYS, 1, threads);
+  size_t slice = (n + threads - 1) / threads;
+
+  std::vector<std::jthread> workers;
+  for (size_t begin = slice; begin < n; begin += slice) {
+    workers.emplace_back(fn, begin, std::min(n, begin + slice));
+  }
+  fn(size_t{0}, std::min(n, slice));
+}
+
+template <typename T,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy>
 class BloomRfImpl {
-  static_assert(std::is_unsigned_v<T>);
+  static_assert(isUnsignedKey<T>);
   static_assert(std::is_unsigned_v<UnderType>);
+  static_assert(std::atomic_ref<UnderType>::is_always_lock_free);
 
  public:
-  using Container = std::unique_ptr<UnderType[]>;
+  using Container = std::unique_ptr<UnderType[], FilterDeleter<UnderType>>;
 
   explicit BloomRfImpl(const BloomFilterRFParameters& params);
 
   void add(T data);
 
+  /// Inserts all keys of data.  Keys are processed in blocks of BATCH_SIZE,
+  /// one layer at a time: the target words of a whole block are computed and
+  /// prefetched before any of them is written.
+  void addBatch(std::span<const T> data);
+
+  /// Like add and addBatch, but safe to call from several threads at once
+  /// and concurrently with lookups.  Bits are set with relaxed atomic
+  /// fetch_or, skipping words that already hold them, and lookups read every
+  /// word with a relaxed atomic load.  A lookup that
+  /// happens after an addConcurrent returned, e.g. because the key was
+  /// handed to the reader through a mutex or a release store, finds the
+  /// key.  add and addBatch must not run concurrently with anything else.
+  void addConcurrent(T data);
+  void addBatchConcurrent(std::span<const T> data);
+
+  /// Like addBatchConcurrent, but splits data into contiguous slices that
+  /// up to threads threads insert in parallel.  Sorted input suits this
+  /// best, since the slices then rarely share words.
+  void addBatchParallel(std::span<const T> data,
+                        size_t threads = detail::defaultThreads());
+
   bool find(T data) const;
 
+  /// Point lookup of every key in data; out[j] receives find(data[j]).  The
+  /// probes of a block of keys are issued layer by layer with all words of a
+  /// layer prefetched up front, so the cache misses of different keys overlap.
+  void findBatch(std::span<const T> data, bool* out) const;
+
   bool findRange(T lkey, T hkey) const;
 
+  /// Like findRange, but adds the checks and words of every layer to stats.
+  /// Only this overload is instrumented, the one above is not slowed down.
+  bool findRange(T lkey, T hkey, QueryStats& stats) const;
+
+  /// Range lookup of every [low, high] pair in ranges; out[j] receives
+  /// findRange(ranges[j].first, ranges[j].second).  The ranges are
+  /// traversed in sorted order, a layer at a time for a group of ranges, so
+  /// that probes of neighbouring ranges are shared and the words of a layer
+  /// are prefetched before they are tested.
+  void findRangeBatch(std::span<const std::pair<T, T>> ranges, bool* out) const;
+
+  /// ORs the words of other into this filter, which then finds every key
+  /// that was added to either of them, as if they had all been added to
+  /// it.  Throws std::logic_error unless other has the same configuration
+  /// (seed, delta, size, layout and index reduction).
+  void mergeFrom(const BloomRfImpl& other);
+
+  /// ANDs the words of other into this filter, which then finds every key
+  /// that was added to both.  It may still find keys that were added to
+  /// only one of them, more often than a filter of just the common keys
+  /// would.  Same requirements as mergeFrom.
+  void intersect(const BloomRfImpl& other);
+
+  /// Writes the filter in the versioned binary format described in
+  /// bloomRF.cpp.  keyType is the key type of the wrapping BloomRF.
+  void serialize(std::ostream& out, KeyType keyType) const;
+  std::vector<char> serialize(KeyType keyType) const;
+
+  /// Reads a filter written by serialize.  Throws std::runtime_error if the
+  /// input is truncated or corrupt, or if it was written with a different
+  /// key type, UnderType or hash policy.
+  static BloomRfImpl deserialize(std::istream& in, KeyType keyType);
+  static BloomRfImpl deserialize(std::span<const char> buffer,
+                                 KeyType keyType);
+
+  /// Like deserialize, but the returned filter borrows its words from buffer
+  /// instead of copying them.  buffer has to outlive the filter, and its
+  /// words have to be aligned for UnderType.  Verifying the checksum reads
+  /// the whole buffer, so skip it to page in mapped filters lazily.
+  static BloomRfImpl view(std::span<const char> buffer,
+                          KeyType keyType,
+                          bool verifyChecksum);
+
+  /// Counts the set bits of the filter, and of the sub-array of every layer
+  /// if they have their own.  Reads every word, so it takes about as long as
+  /// a merge.  The words are read with plain loads, so unlike find and
+  /// findRange it must not run concurrently with addConcurrent; callers
+  /// have to stop adds while it runs.
+  FillEstimate estimateFill() const;
+
+  /// Estimated false positive rate of findRange for ranges of width keys.
+  /// Follows the checks that findRange makes on a few ranges spread over
+  /// the domain and weighs each by the fill of its layer.
+  double estimateRangeFpr(T width) const;
+  double estimateRangeFpr(T width, const FillEstimate& fill) const;
+
   const Container& getFilter() const { return filter; }
   Container& getFilter() { return filter; }
 
   const std::vector<size_t>& getDelta() { return delta; }
 
+  /// Returns size in bits.
+  size_t numBits() const { return 8 * sizeof(UnderType) * words; }
+
+  /// Calls fn(word, mask) for the word and the bit that each layer sets for
+  /// data.
+  template <typename Fn>
+  void forEachBit(T data, Fn fn) const {
+    size_t block = blockOf(data);
+    for (size_t i = 0; i < hashes; ++i) {
+      auto [word, mask] =
+          wordToIndexAndBitMask(data, i, bloomRFHashToWord(data, i, block));
+      fn(word, mask);
+    }
+  }
+
  private:
+  /// The checks of one layer of a range query.  Checks that lie within
+  /// [lkey, hkey] are handed to a visitor as soon as they are produced.  Only
+  /// the checks that straddle lkey or hkey are stored, since only those are
+  /// split further on the next lower layer.  The checks of a layer are
+  /// disjoint, so at most two of them straddle a boundary and a range query
+  /// never needs to allocate.
   class Checks {
    public:
-    enum class IntervalLocation { Left, Right, NotYetSplit };
-
     struct Check {
-      Check(T low_, T high_)
-          : low{low_}, high{high_} {}
-
       T low;
       T high;
     };
 
-    Checks(T lkey_, T hkey_, std::vector<Check>&& checks_)
-        : checks{std::move(checks_)}, lkey(lkey_), hkey(hkey_) {}
+    static constexpr size_t MAX_PARTIAL_CHECKS = 2;
 
-    const auto& getChecks() { return checks; }
+    Checks(T lkey_, T hkey_) : lkey(lkey_), hkey(hkey_) {}
 
-    void initChecks(size_t delta_sum, size_t delta_back);
+    const Check* begin() const { return checks.data(); }
+    const Check* end() const { return checks.data() + size; }
 
-    void advanceChecks(size_t shifts, size_t delta);
+    /// Splits the whole domain into the checks of the top layer.
+    template <typename Visit>
+    bool initChecks(size_t delta_sum, size_t delta_back, Visit visitCovered);
 
-    void concatenateChecks(const Checks& other) {
-      checks.insert(checks.end(), other.checks.begin(), other.checks.end());
-    }
-
-    void compressChecks(size_t total_shift);
+    /// Splits check into the checks of the next lower layer, whose shift and
+    /// delta are given.  Partial checks are stored, covered ones are passed
+    /// to visitCovered.  Returns true as soon as visitCovered does.
+    template <typename Visit>
+    bool advanceCheck(const Check& check,
+                      size_t shifts,
+                      size_t delta,
+                      Visit visitCovered);
 
    private:
-    std::vector<Check> checks;
-    size_t domain_width = 8 * sizeof(T);
+    bool isPartial(const Check& check) const {
+      return check.low < lkey || check.high > hkey;
+    }
+
+    std::array<Check, MAX_PARTIAL_CHECKS> checks;
+    size_t size = 0;
     T lkey;
     T hkey;
-
-    friend class BloomRfImpl;
   };
 
   UnderType buildBitMaskForRange(T low, T high, size_t i, int wordPos) const;
 
-  explicit BloomRfImpl(size_t size_, size_t seed_, std::vector<size_t> delta);
+  /// Estimated false positive rate of findRange(low, high) if [low, high]
+  /// is empty.
+  double rangeFprOf(T low, T high, const FillEstimate& fill) const;
 
-  /// Returns size in bits.
-  size_t numBits() const { return 8 * sizeof(UnderType) * words; }
+  /// Lookups read words with relaxed atomic loads, which compile to plain
+  /// loads, so that they may run concurrently with addConcurrent.
+  UnderType loadWord(size_t i) const {
+    return std::atomic_ref<UnderType>(filter[i]).load(
+        std::memory_order_relaxed);
+  }
+
+  template <bool Concurrent>
+  void orWord(size_t i, UnderType bits) {
+    if constexpr (Concurrent) {
+      // Upper layers share few words between many keys.  Not writing words
+      // that are already set keeps their cache lines shared between cores.
+      if ((loadWord(i) & bits) != bits) {
+        std::atomic_ref<UnderType>(filter[i]).fetch_or(
+            bits, std::memory_order_relaxed);
+      }
+    } else {
+      filter[i] |= bits;
+    }
+  }
+
+  template <bool Concurrent>
+  void addKey(T data);
+
+  template <bool Concurrent>
+  void addKeys(std::span<const T> data);
+
+  /// findRange, which updates stats if WithStats is set.
+  template <bool WithStats>
+  bool findRangeWithStats(T lkey, T hkey, QueryStats* stats) const;
+
+  /// Combines the words of other into this filter, see mergeFrom.
+  void combineWith(const BloomRfImpl& other, WordOp op);
+
+  /// Whether other maps every key to the same bits as this filter.
+  bool sameConfiguration(const BloomRfImpl& other) const {
+    return seed == other.seed && delta == other.delta &&
+           words == other.words && layout == other.layout &&
+           blockedLayers == other.blockedLayers &&
+           layerWords == other.layerWords && reduction == other.reduction;
+  }
+
+  /// Calls fn(word, mask) for the words of the PMHF word pos that the
+  /// covered check [low, high] of layer tests, with the bits it tests.
+  template <typename Fn>
+  void forEachCoveredWord(T low, T high, int layer, size_t pos, Fn fn) const {
+    constexpr size_t WORD_BITS = 8 * sizeof(UnderType);
+    if ((size_t{1} << (delta[layer] - 1)) <= WORD_BITS) {
+      size_t wordsPerUnderTypeLog =
+          std::countr_zero(WORD_BITS) - (delta[layer] - 1);
+      fn(pos >> wordsPerUnderTypeLog,
+         buildBitMaskForRange(
+             low, high, layer,
+             pos & ((size_t{1} << wordsPerUnderTypeLog) - 1)));
+      return;
+    }
+    size_t pmhfBits = size_t{1} << (delta[layer] - 1);
+    size_t lowOffset = (low >> shifts[layer]) & (pmhfBits - 1);
+    size_t highOffset = (high >> shifts[layer]) & (pmhfBits - 1);
+    size_t first = pos * (pmhfBits / WORD_BITS);
+    for (size_t i = lowOffset / WORD_BITS; i <= highOffset / WORD_BITS; ++i) {
+      UnderType bitmask = ~UnderType{0};
+      if (i == lowOffset / WORD_BITS) {
+        bitmask &= ~UnderType{0} << (lowOffset % WORD_BITS);
+      }
+      if (i == highOffset / WORD_BITS) {
+        bitmask &= ~UnderType{0} >> (WORD_BITS - 1 - highOffset % WORD_BITS);
+      }
+      fn(first + i, bitmask);
+    }
+  }
+
+  /// Everything of the serialized format that precedes the words.
+  std::vector<char> serializeHeader(KeyType keyType) const;
+
+  /// Checksum over the serialized header and the words.
+  uint64_t checksum(std::span<const char> header) const;
+
+  /// Reads and validates the serialized header from read(char* dst, size_t
+  /// n), which has to fill dst with the next n bytes of the input or throw.
+  /// The raw header bytes are left in header.
+  template <typename Read>
+  static BloomFilterRFParameters readHeader(Read read,
+                                            KeyType keyType,
+                                            std::vector<char>& header);
+
+  /// Deserializes from read, see readHeader.  remaining() returns the
+  /// number of bytes left in the input as a std::optional<size_t>, or
+  /// std::nullopt if it is unknown.
+  template <typename Read, typename Remaining>
+  static BloomRfImpl deserializeFrom(Read read,
+                                     Remaining remaining,
+                                     KeyType keyType);
+
+  /// Constructs the filter of parameters read by readHeader.  Parameters
+  /// that the header checks let through but the constructor rejects are
+  /// corrupt too, so this throws std::runtime_error for them.
+  static BloomRfImpl fromSerialized(const BloomFilterRFParameters& params,
+                                    Container filter_);
+
+  /// Uses filter_ as storage if it is non-null, otherwise allocates it.
+  BloomRfImpl(const BloomFilterRFParameters& params, Container filter_);
 
   /// Computes the ith PMHF hash of data. Only returns the word
   /// to which the data maps to.  Use bloomRFRemainder to retrieve the
   /// offset.
-  size_t bloomRFHashToWord(T data, size_t i) const;
+  size_t bloomRFHashToWord(T data, size_t i) const {
+    return bloomRFHashToWord(data, i, blockOf(data));
+  }
+
+  /// Like bloomRFHashToWord, but for an already computed
+  /// block = blockOf(data).
+  size_t bloomRFHashToWord(T data, size_t i, size_t block) const;
+
+  /// Returns the block that holds the blocked layers of data, or 0 for the
+  /// flat layout.
+  size_t blockOf(T data) const;
+
+  /// Remembers the block of the prefix that was probed last.  The blocked
+  /// probes of a range query mostly share a block, so this saves hashing
+  /// the prefix again for each of them.
+  class BlockCache {
+   public:
+    explicit BlockCache(const BloomRfImpl& impl_) : impl(impl_) {}
+
+    /// Returns bloomRFHashToWord(data, i).
+    size_t hashToWord(T data, size_t i) {
+      if (i >= impl.blockedLayers) {
+        return impl.bloomRFHashToWord(data, i, 0);
+      }
+      T dataPrefix = data >> impl.blockShift;
+      if (!valid || dataPrefix != prefix) {
+        prefix = dataPrefix;
+        block = impl.blockOf(data);
+        valid = true;
+      }
+      return impl.bloomRFHashToWord(data, i, block);
+    }
+
+   private:
+    const BloomRfImpl& impl;
+    T prefix = 0;
+    size_t block = 0;
+    bool valid = false;
+  };
 
   UnderType bloomRFRemainder(T data, size_t i, int wordPos) const;
 
   std::pair<size_t, UnderType> hashToIndexAndBitMask(T data, size_t i) const;
 
+  /// Like hashToIndexAndBitMask, but for an already computed
+  /// pos = bloomRFHashToWord(data, i).
+  std::pair<size_t, UnderType> wordToIndexAndBitMask(T data,
+                                                     size_t i,
+                                                     size_t pos) const;
+
   size_t hash(T data, size_t i) const;
 
+  /// Maps hash to [0, n) as selected by reduction.
+  size_t reduce(uint64_t hash, size_t n) const {
+    switch (reduction) {
+      case IndexReduction::MultiplyShift:
+        return static_cast<size_t>(
+            (static_cast<unsigned __int128>(hash) * n) >> 64);
+      case IndexReduction::PowerOfTwo:
+        return hash & (n - 1);
+      default:
+        return hash % n;
+    }
+  }
+
   bool checkDIOfDecomposition(T low, T high, int layer) const;
 
+  /// Like checkDIOfDecomposition, but for an already computed
+  /// pos = bloomRFHashToWord(low, layer).
+  bool checkDIOfDecomposition(T low, T high, int layer, size_t pos) const;
+
   /// Number of hash functions.
   size_t hashes;
 
@@ -115,6 +721,27 @@ class BloomRfImpl {
 
   size_t words;
 
+  Layout layout;
+
+  IndexReduction reduction;
+
+  /// Number of layers that share a block, 0 for the flat layout.
+  size_t blockedLayers;
+
+  /// Number of blocks of the blocked layout.
+  size_t blocks;
+
+  /// Shift of the prefix that selects the block.
+  size_t blockShift;
+
+  /// Words of the sub-array of each layer, empty if the layers share the
+  /// whole filter.
+  std::vector<size_t> layerWords;
+
+  /// First PMHF word and number of PMHF words that each layer hashes into.
+  std::vector<size_t> layerFirstPmhfWord;
+  std::vector<size_t> layerPmhfWords;
+
   /// Distance between layers.
   const std::vector<size_t> delta;
 
@@ -125,22 +752,132 @@ class BloomRfImpl {
   uint16_t domain_size = 8 * sizeof(T);
 
   Container filter;
+
+  template <typename, typename, typename>
+  friend class filters::BloomRFShardSet;
 };
 
+// Defined here rather than in bloomRF.cpp, since classes outside of it
+// split checks with visitors of their own.
+template <typename T, typename UnderType, typename HashPolicy>
+template <typename Visit>
+bool BloomRfImpl<T, UnderType, HashPolicy>::Checks::advanceCheck(
+    const Check& check,
+    size_t shifts,
+    size_t delta,
+    Visit visitCovered) {
+  T target_width = T{1} << shifts;
+
+  T bm_for_max = (T{1} << (shifts + delta - 1)) - 1;
+  T lower_limit = (std::max(check.low, lkey) / target_width) * target_width;
+  T upper_limit = (std::min(hkey, check.high) / target_width) * target_width;
+
+  for (T counter = lower_limit;
+       counter <= upper_limit && counter >= lower_limit;) {
+    T curr_high = counter + target_width;
+    Check next_check;
+    if (counter < lkey || curr_high > hkey) {
+      next_check = {counter, static_cast<T>(curr_high - 1)};
+      counter = curr_high;
+    } else {
+      T next;
+      if (static_cast<T>(counter | bm_for_max) <= upper_limit) {
+        next = static_cast<T>(counter | bm_for_max);
+      } else {
+        next = upper_limit;
+      }
+      next_check = {counter, next};
+      counter = next + 1;
+    }
+
+    if (isPartial(next_check)) {
+      assert(size < MAX_PARTIAL_CHECKS);
+      checks[size++] = next_check;
+    } else if (visitCovered(next_check)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T, typename UnderType, typename HashPolicy>
+template <typename Visit>
+bool BloomRfImpl<T, UnderType, HashPolicy>::Checks::initChecks(
+    size_t delta_sum,
+    size_t delta_back,
+    Visit visitCovered) {
+  T low = 0;
+  T high = ~low;
+
+  if (size > 0) {
+    throw std::logic_error{
+        "Cannot init checks on a non-empty checks instance."};
+  }
+
+  return advanceCheck({low, high}, delta_sum, delta_back, visitCovered);
+}
+
 } // namespace detail
 
 //
 // A wrapper on BloomRFImpl.
 //
-template <typename Key, typename UnderType = uint64_t, typename = void>
-class BloomRF : private detail::BloomRfImpl<Key, UnderType> {
+template <typename Key,
+          typename UnderType = uint64_t,
+          typename HashPolicy = CityHashPolicy,
+          typename = void>
+class BloomRF : private detail::BloomRfImpl<Key, UnderType, HashPolicy> {
+  using Impl = detail::BloomRfImpl<Key, UnderType, HashPolicy>;
+
  public:
-  using detail::BloomRfImpl<Key, UnderType>::add;
-  using detail::BloomRfImpl<Key, UnderType>::find;
-  using detail::BloomRfImpl<Key, UnderType>::findRange;
-  using detail::BloomRfImpl<Key, UnderType>::getDelta;
-  using detail::BloomRfImpl<Key, UnderType>::getFilter;
-  using detail::BloomRfImpl<Key, UnderType>::BloomRfImpl;
+  using Impl::add;
+  using Impl::addBatch;
+  using Impl::addBatchConcurrent;
+  using Impl::addBatchParallel;
+  using Impl::addConcurrent;
+  using Impl::find;
+  using Impl::findBatch;
+  using Impl::findRange;
+  using Impl::findRangeBatch;
+  using Impl::estimateFill;
+  using Impl::estimateRangeFpr;
+  using Impl::getDelta;
+  using Impl::getFilter;
+  using Impl::BloomRfImpl;
+
+  void mergeFrom(const BloomRF& other) { Impl::mergeFrom(other); }
+  void intersect(const BloomRF& other) { Impl::intersect(other); }
+
+  void serialize(std::ostream& out) const {
+    Impl::serialize(out, detail::keyTypeOf<Key>());
+  }
+
+  std::vector<char> serialize() const {
+    return Impl::serialize(detail::keyTypeOf<Key>());
+  }
+
+  static BloomRF deserialize(std::istream& in) {
+    return BloomRF{Impl::deserialize(in, detail::keyTypeOf<Key>())};
+  }
+
+  static BloomRF deserialize(std::span<const char> buffer) {
+    return BloomRF{Impl::deserialize(buffer, detail::keyTypeOf<Key>())};
+  }
+
+ private:
+  explicit BloomRF(Impl&& impl) : Impl(std::move(impl)) {}
+
+  using Impl::forEachBit;
+  using Impl::numBits;
+
+  template <typename, typename, typename>
+  friend class BloomRFView;
+  template <typename, typename, typename>
+  friend class CountingBloomRF;
+  template <typename, typename, typename>
+  friend class ScalableBloomRF;
+  template <typename, typename, typename>
+  friend class BloomRFShardSet;
 };
 
 
@@ -150,38 +887,119 @@ class BloomRF : private detail::BloomRfImpl<Key, UnderType> {
 // integers in an order preserving way, and then makes the calls to
 // the BloomRF on the unsigned integers.
 //
-template <typename Key, typename UnderType>
-class BloomRF<Key, UnderType, std::enable_if_t<std::is_signed_v<Key> && !std::is_floating_point_v<Key>>>
-    : private detail::BloomRfImpl<std::make_unsigned_t<Key>, UnderType> {
+template <typename Key, typename UnderType, typename HashPolicy>
+class BloomRF<Key,
+              UnderType,
+              HashPolicy,
+              std::enable_if_t<std::is_signed_v<Key> &&
+                               !std::is_floating_point_v<Key>>>
+    : private detail::
+          BloomRfImpl<std::make_unsigned_t<Key>, UnderType, HashPolicy> {
   using UnsignedKey = std::make_unsigned_t<Key>;
+  using Impl = detail::BloomRfImpl<UnsignedKey, UnderType, HashPolicy>;
+
+  static constexpr UnsignedKey toUnsigned(Key data) {
+    return static_cast<UnsignedKey>(data) -
+           static_cast<UnsignedKey>(std::numeric_limits<Key>::min());
+  }
 
  public:
-  void add(Key data) {
-    UnsignedKey unsignedData =
-        static_cast<UnsignedKey>(data) - static_cast<UnsignedKey>(std::numeric_limits<Key>::min());
-    detail::BloomRfImpl<UnsignedKey, UnderType>::add(unsignedData);
+  void add(Key data) { Impl::add(toUnsigned(data)); }
+
+  void addBatch(std::span<const Key> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned, [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatch(block);
+        });
+  }
+
+  void addConcurrent(Key data) { Impl::addConcurrent(toUnsigned(data)); }
+
+  void addBatchConcurrent(std::span<const Key> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned, [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatchConcurrent(block);
+        });
+  }
+
+  void addBatchParallel(std::span<const Key> data,
+                        size_t threads = detail::defaultThreads()) {
+    detail::forEachSliceInParallel(
+        data.size(), threads, [this, data](size_t begin, size_t end) {
+          addBatchConcurrent(data.subspan(begin, end - begin));
+        });
+  }
+
+  bool find(Key data) const { return Impl::find(toUnsigned(data)); }
+
+  void findBatch(std::span<const Key> data, bool* out) const {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned,
+        [this, out](std::span<const UnsignedKey> block, size_t offset) {
+          Impl::findBatch(block, out + offset);
+        });
   }
 
-  bool find(Key data) {
-    UnsignedKey unsignedData =
-        static_cast<UnsignedKey>(data) - static_cast<UnsignedKey>(std::numeric_limits<Key>::min());
-    return detail::BloomRfImpl<UnsignedKey, UnderType>::find(unsignedData);
+  bool findRange(Key lkey, Key hkey) const {
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey));
   }
 
-  bool findRange(Key lkey, Key hkey) {
-    UnsignedKey unsignedLow =
-        static_cast<UnsignedKey>(lkey) -
-        static_cast<UnsignedKey>(std::numeric_limits<Key>::min());
-    UnsignedKey unsignedHigh =
-        static_cast<UnsignedKey>(hkey) -
-        static_cast<UnsignedKey>(std::numeric_limits<Key>::min());
-    return detail::BloomRfImpl<UnsignedKey, UnderType>::findRange(unsignedLow,
-                                                          unsignedHigh);
+  bool findRange(Key lkey, Key hkey, QueryStats& stats) const {
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey), stats);
   }
 
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::getDelta;
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::getFilter;
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::BloomRfImpl;
+  void findRangeBatch(std::span<const std::pair<Key, Key>> ranges,
+                      bool* out) const {
+    std::vector<std::pair<UnsignedKey, UnsignedKey>> converted(ranges.size());
+    std::transform(ranges.begin(), ranges.end(), converted.begin(),
+                   [](const auto& range) {
+                     return std::pair{toUnsigned(range.first),
+                                      toUnsigned(range.second)};
+                   });
+    Impl::findRangeBatch(converted, out);
+  }
+
+  using Impl::estimateFill;
+  using Impl::estimateRangeFpr;
+  using Impl::getDelta;
+  using Impl::getFilter;
+  using Impl::BloomRfImpl;
+
+  void mergeFrom(const BloomRF& other) { Impl::mergeFrom(other); }
+  void intersect(const BloomRF& other) { Impl::intersect(other); }
+
+  void serialize(std::ostream& out) const {
+    Impl::serialize(out, detail::keyTypeOf<Key>());
+  }
+
+  std::vector<char> serialize() const {
+    return Impl::serialize(detail::keyTypeOf<Key>());
+  }
+
+  static BloomRF deserialize(std::istream& in) {
+    return BloomRF{Impl::deserialize(in, detail::keyTypeOf<Key>())};
+  }
+
+  static BloomRF deserialize(std::span<const char> buffer) {
+    return BloomRF{Impl::deserialize(buffer, detail::keyTypeOf<Key>())};
+  }
+
+ private:
+  explicit BloomRF(Impl&& impl) : Impl(std::move(impl)) {}
+
+  template <typename Fn>
+  void forEachBit(Key data, Fn fn) const {
+    Impl::forEachBit(toUnsigned(data), fn);
+  }
+
+  using Impl::numBits;
+
+  template <typename, typename, typename>
+  friend class BloomRFView;
+  template <typename, typename, typename>
+  friend class CountingBloomRF;
+  template <typename, typename, typename>
+  friend class ScalableBloomRF;
 };
 
 
@@ -208,11 +1026,18 @@ struct FloatToUInt<double> {
 // Floating point support.  We need to map floats to unsigned integers in a way that preserves
 // ordering (if x < y then converted(x) < converted(y)).
 //
-template <typename FloatKey, typename UnderType>
-class BloomRF<FloatKey, UnderType, std::enable_if_t<std::is_floating_point_v<FloatKey>>>
-    : private detail::BloomRfImpl<typename detail::FloatToUInt<FloatKey>::uint_type, UnderType> {
+template <typename FloatKey, typename UnderType, typename HashPolicy>
+class BloomRF<FloatKey,
+              UnderType,
+              HashPolicy,
+              std::enable_if_t<std::is_floating_point_v<FloatKey>>>
+    : private detail::BloomRfImpl<
+          typename detail::FloatToUInt<FloatKey>::uint_type,
+          UnderType,
+          HashPolicy> {
 
   using UnsignedKey = typename detail::FloatToUInt<FloatKey>::uint_type;
+  using Impl = detail::BloomRfImpl<UnsignedKey, UnderType, HashPolicy>;
   using SignedKey = std::make_signed_t<UnsignedKey>;
 
   // See https://stackoverflow.com/questions/52370587/converting-floating-point-to-unsigned-int-while-preserving-order
@@ -247,25 +1072,336 @@ class BloomRF<FloatKey, UnderType, std::enable_if_t<std::is_floating_point_v<Flo
 public:
   void add(FloatKey data) {
     UnsignedKey unsignedData = orderPreservingFloatToUInt(data);
-    detail::BloomRfImpl<UnsignedKey, UnderType>::add(unsignedData);
+    Impl::add(unsignedData);
+  }
+
+  void addBatch(std::span<const FloatKey> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, orderPreservingFloatToUInt,
+        [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatch(block);
+        });
   }
 
-  bool find(FloatKey data) {
+  void addConcurrent(FloatKey data) {
+    Impl::addConcurrent(orderPreservingFloatToUInt(data));
+  }
+
+  void addBatchConcurrent(std::span<const FloatKey> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, orderPreservingFloatToUInt,
+        [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatchConcurrent(block);
+        });
+  }
+
+  void addBatchParallel(std::span<const FloatKey> data,
+                        size_t threads = detail::defaultThreads()) {
+    detail::forEachSliceInParallel(
+        data.size(), threads, [this, data](size_t begin, size_t end) {
+          addBatchConcurrent(data.subspan(begin, end - begin));
+        });
+  }
+
+  bool find(FloatKey data) const {
     UnsignedKey unsignedData = orderPreservingFloatToUInt(data);
-    return detail::BloomRfImpl<UnsignedKey, UnderType>::find(unsignedData);
+    return Impl::find(unsignedData);
+  }
+
+  void findBatch(std::span<const FloatKey> data, bool* out) const {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, orderPreservingFloatToUInt,
+        [this, out](std::span<const UnsignedKey> block, size_t offset) {
+          Impl::findBatch(block, out + offset);
+        });
   }
 
-  bool findRange(FloatKey lkey, FloatKey hkey) {
+  bool findRange(FloatKey lkey, FloatKey hkey) const {
     UnsignedKey unsignedLow = orderPreservingFloatToUInt(lkey);
     UnsignedKey unsignedHigh = orderPreservingFloatToUInt(hkey);
-    return detail::BloomRfImpl<UnsignedKey, UnderType>::findRange(unsignedLow,
-                                                          unsignedHigh);
+    return Impl::findRange(unsignedLow, unsignedHigh);
+  }
+
+  bool findRange(FloatKey lkey, FloatKey hkey, QueryStats& stats) const {
+    return Impl::findRange(orderPreservingFloatToUInt(lkey),
+                           orderPreservingFloatToUInt(hkey), stats);
+  }
+
+  void findRangeBatch(std::span<const std::pair<FloatKey, FloatKey>> ranges,
+                      bool* out) const {
+    std::vector<std::pair<UnsignedKey, UnsignedKey>> converted(ranges.size());
+    std::transform(ranges.begin(), ranges.end(), converted.begin(),
+                   [](const auto& range) {
+                     return std::pair{orderPreservingFloatToUInt(range.first),
+                                      orderPreservingFloatToUInt(range.second)};
+                   });
+    Impl::findRangeBatch(converted, out);
+  }
+
+  using Impl::estimateFill;
+  using Impl::estimateRangeFpr;
+  using Impl::getDelta;
+  using Impl::getFilter;
+  using Impl::BloomRfImpl;
+
+  void mergeFrom(const BloomRF& other) { Impl::mergeFrom(other); }
+  void intersect(const BloomRF& other) { Impl::intersect(other); }
+
+  void serialize(std::ostream& out) const {
+    Impl::serialize(out, detail::keyTypeOf<FloatKey>());
+  }
+
+  std::vector<char> serialize() const {
+    return Impl::serialize(detail::keyTypeOf<FloatKey>());
+  }
+
+  static BloomRF deserialize(std::istream& in) {
+    return BloomRF{Impl::deserialize(in, detail::keyTypeOf<FloatKey>())};
+  }
+
+  static BloomRF deserialize(std::span<const char> buffer) {
+    return BloomRF{Impl::deserialize(buffer, detail::keyTypeOf<FloatKey>())};
   }
 
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::getDelta;
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::getFilter;
-  using detail::BloomRfImpl<UnsignedKey, UnderType>::BloomRfImpl;
+ private:
+  explicit BloomRF(Impl&& impl) : Impl(std::move(impl)) {}
 
+  template <typename Fn>
+  void forEachBit(FloatKey data, Fn fn) const {
+    Impl::forEachBit(orderPreservingFloatToUInt(data), fn);
+  }
+
+  using Impl::numBits;
+
+  template <typename, typename, typename>
+  friend class BloomRFView;
+  template <typename, typename, typename>
+  friend class CountingBloomRF;
+  template <typename, typename, typename>
+  friend class ScalableBloomRF;
+};
+
+
+namespace detail {
+
+/// The narrowest unsigned key type of BloomRfImpl with at least Bits bits.
+template <size_t Bits>
+using UIntOfBits = std::conditional_t<
+    Bits <= 16,
+    uint16_t,
+    std::conditional_t<
+        Bits <= 32,
+        uint32_t,
+        std::conditional_t<Bits <= 64, uint64_t, unsigned __int128>>>;
+
+template <typename T>
+struct IsIntegralPair : std::false_type {};
+
+template <typename First, typename Second>
+struct IsIntegralPair<std::pair<First, Second>>
+    : std::bool_constant<std::is_integral_v<First> &&
+                         std::is_integral_v<Second>> {};
+
+/// Maps an integer to an unsigned integer of the same width in an order
+/// preserving way.
+template <typename Int>
+constexpr std::make_unsigned_t<Int> orderPreservingToUnsigned(Int x) {
+  using Unsigned = std::make_unsigned_t<Int>;
+  return static_cast<Unsigned>(x) -
+         static_cast<Unsigned>(std::numeric_limits<Int>::min());
+}
+
+}  // namespace detail
+
+
+//
+// Composite keys.  A (prefix, suffix) pair of integers, e.g. a (series id,
+// timestamp) pair, is mapped to prefix << bits(suffix) | suffix in the
+// narrowest unsigned key type that holds both, so the order of the filter is
+// the lexicographic order of the pairs.  A range of suffixes within one
+// prefix is then a single range of the filter and findRange answers it with
+// one probe of the layers, without a filter per prefix.
+//
+// Since the delta vector covers the combined key, layers that only cover
+// suffix bits serve the short ranges within a prefix, and the top layers
+// hash the prefix.  Composite filters are not serializable.
+//
+template <typename CompositeKey, typename UnderType, typename HashPolicy>
+class BloomRF<CompositeKey,
+              UnderType,
+              HashPolicy,
+              std::enable_if_t<detail::IsIntegralPair<CompositeKey>::value>>
+    : private detail::BloomRfImpl<
+          detail::UIntOfBits<8 * (sizeof(typename CompositeKey::first_type) +
+                                  sizeof(typename CompositeKey::second_type))>,
+          UnderType,
+          HashPolicy> {
+  using Prefix = typename CompositeKey::first_type;
+  using Suffix = typename CompositeKey::second_type;
+  static constexpr size_t SUFFIX_BITS = 8 * sizeof(Suffix);
+  using UnsignedKey =
+      detail::UIntOfBits<8 * sizeof(Prefix) + SUFFIX_BITS>;
+  using Impl = detail::BloomRfImpl<UnsignedKey, UnderType, HashPolicy>;
+
+  static constexpr UnsignedKey toUnsigned(const CompositeKey& data) {
+    return static_cast<UnsignedKey>(
+               static_cast<UnsignedKey>(
+                   detail::orderPreservingToUnsigned(data.first))
+               << SUFFIX_BITS) |
+           detail::orderPreservingToUnsigned(data.second);
+  }
+
+  static_assert(toUnsigned({1, std::numeric_limits<Suffix>::min()}) >
+                toUnsigned({0, std::numeric_limits<Suffix>::max()}));
+  static_assert(toUnsigned({std::numeric_limits<Prefix>::max(),
+                            std::numeric_limits<Suffix>::max()}) ==
+                std::numeric_limits<UnsignedKey>::max() >>
+                    (8 * sizeof(UnsignedKey) - 8 * sizeof(Prefix) -
+                     SUFFIX_BITS));
+
+ public:
+  void add(const CompositeKey& data) { Impl::add(toUnsigned(data)); }
+
+  void addBatch(std::span<const CompositeKey> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned, [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatch(block);
+        });
+  }
+
+  void addConcurrent(const CompositeKey& data) {
+    Impl::addConcurrent(toUnsigned(data));
+  }
+
+  void addBatchConcurrent(std::span<const CompositeKey> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned, [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatchConcurrent(block);
+        });
+  }
+
+  void addBatchParallel(std::span<const CompositeKey> data,
+                        size_t threads = detail::defaultThreads()) {
+    detail::forEachSliceInParallel(
+        data.size(), threads, [this, data](size_t begin, size_t end) {
+          addBatchConcurrent(data.subspan(begin, end - begin));
+        });
+  }
+
+  bool find(const CompositeKey& data) const {
+    return Impl::find(toUnsigned(data));
+  }
+
+  void findBatch(std::span<const CompositeKey> data, bool* out) const {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned,
+        [this, out](std::span<const UnsignedKey> block, size_t offset) {
+          Impl::findBatch(block, out + offset);
+        });
+  }
+
+  /// Whether the filter may hold a key between lkey and hkey in
+  /// lexicographic order.
+  bool findRange(const CompositeKey& lkey, const CompositeKey& hkey) const {
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey));
+  }
+
+  bool findRange(const CompositeKey& lkey,
+                 const CompositeKey& hkey,
+                 QueryStats& stats) const {
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey), stats);
+  }
+
+  /// Whether the filter may hold a key with the given prefix and a suffix in
+  /// [lsuffix, hsuffix].
+  bool findRange(Prefix prefix, Suffix lsuffix, Suffix hsuffix) const {
+    return findRange(CompositeKey{prefix, lsuffix},
+                     CompositeKey{prefix, hsuffix});
+  }
+
+  void findRangeBatch(std::span<const std::pair<CompositeKey, CompositeKey>> ranges,
+                      bool* out) const {
+    std::vector<std::pair<UnsignedKey, UnsignedKey>> converted(ranges.size());
+    std::transform(ranges.begin(), ranges.end(), converted.begin(),
+                   [](const auto& range) {
+                     return std::pair{toUnsigned(range.first),
+                                      toUnsigned(range.second)};
+                   });
+    Impl::findRangeBatch(converted, out);
+  }
+
+  using Impl::estimateFill;
+  using Impl::estimateRangeFpr;
+  using Impl::getDelta;
+  using Impl::getFilter;
+  using Impl::BloomRfImpl;
+
+  void mergeFrom(const BloomRF& other) { Impl::mergeFrom(other); }
+  void intersect(const BloomRF& other) { Impl::intersect(other); }
+
+ private:
+  template <typename Fn>
+  void forEachBit(const CompositeKey& data, Fn fn) const {
+    Impl::forEachBit(toUnsigned(data), fn);
+  }
+
+  using Impl::numBits;
+
+  template <typename, typename, typename>
+  friend class CountingBloomRF;
+  template <typename, typename, typename>
+  friend class ScalableBloomRF;
+};
+
+
+//
+// A read-only BloomRF that borrows its words, e.g. from a filter that was
+// serialized next to an SSTable and mapped into memory with MappedFile.
+// Lookups run the same code as BloomRF directly on the borrowed words, so
+// the kernel pages them in on demand and shares them between processes.
+//
+template <typename Key, typename UnderType, typename HashPolicy>
+class BloomRFView {
+  using Filter = BloomRF<Key, UnderType, HashPolicy>;
+
+ public:
+  /// buffer holds a filter written by Filter::serialize and has to outlive
+  /// the view.  Its words have to be aligned for UnderType, which holds for
+  /// any buffer that is itself aligned for UnderType.  Verifying the
+  /// checksum reads the whole buffer; skip it to page in filters lazily.
+  explicit BloomRFView(std::span<const char> buffer, bool verifyChecksum = true)
+      : filter(Filter::Impl::view(buffer,
+                                  detail::keyTypeOf<Key>(),
+                                  verifyChecksum)) {}
+
+  bool find(Key data) const { return filter.find(data); }
+
+  void findBatch(std::span<const Key> data, bool* out) const {
+    filter.findBatch(data, out);
+  }
+
+  bool findRange(Key lkey, Key hkey) const {
+    return filter.findRange(lkey, hkey);
+  }
+
+  bool findRange(Key lkey, Key hkey, QueryStats& stats) const {
+    return filter.findRange(lkey, hkey, stats);
+  }
+
+  void findRangeBatch(std::span<const std::pair<Key, Key>> ranges,
+                      bool* out) const {
+    filter.findRangeBatch(ranges, out);
+  }
+
+  FillEstimate estimateFill() const { return filter.estimateFill(); }
+
+  template <typename Width>
+  double estimateRangeFpr(Width width) const {
+    return filter.estimateRangeFpr(width);
+  }
+
+ private:
+  Filter filter;
 };
 
 }  // namespace filters
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bloomRF.h"
+
+namespace filters {
+
+//
+// Many BloomRFs with the same parameters, e.g. one per SSTable, in one
+// allocation.  Word i of every shard is stored next to word i of the others,
+// so the word that a layer probes for a key is at the same index in every
+// shard and the words of all shards are adjacent.  A lookup then walks the
+// layers once for all shards instead of once per filter, and reads one run
+// of words per probe instead of missing the cache in every filter.
+//
+// Lookups return a bitmap with bit s % 64 of word s / 64 set for every
+// shard s that may hold a key.  A shard finds exactly what a BloomRF with
+// the same parameters and keys finds.  Only unsigned integer keys are
+// supported.  Adds are not thread-safe.
+//
+template <typename Key, typename UnderType, typename HashPolicy>
+class BloomRFShardSet {
+  static_assert(detail::isUnsignedKey<Key>);
+
+  using Impl = detail::BloomRfImpl<Key, UnderType, HashPolicy>;
+  using Filter = BloomRF<Key, UnderType, HashPolicy>;
+  using Check = typename Impl::Checks::Check;
+
+ public:
+  using Bitmap = std::vector<uint64_t>;
+
+  /// Throws std::logic_error for invalid parameters, no shards, or more
+  /// words than fit into memory.
+  BloomRFShardSet(const BloomFilterRFParameters& params, size_t shards_)
+      : layout(params, placeholder()),
+        shards(shards_), groups((shards_ + 63) / 64) {
+    if (shards == 0) {
+      throw std::logic_error{"A shard set needs at least one shard."};
+    }
+    if (shards > std::numeric_limits<size_t>::max() / layout.words /
+                     sizeof(UnderType)) {
+      throw std::logic_error{"The shards do not fit into memory."};
+    }
+    // layout only maps keys to words.  Its placeholder is replaced by the
+    // words of all shards, which are placed as params.memory asks.
+    layout.filter = detail::allocateWords<UnderType>(layout.words * shards,
+                                                     params.memory);
+  }
+
+  size_t numShards() const { return shards; }
+
+  static bool contains(const Bitmap& bitmap, size_t shard) {
+    return (bitmap[shard / 64] >> (shard % 64)) & 1;
+  }
+
+  void add(size_t shard, Key key) {
+    checkShard(shard);
+    layout.forEachBit(key, [this, shard](size_t word, UnderType mask) {
+      layout.filter[word * shards + shard] |= mask;
+    });
+  }
+
+  void addBatch(size_t shard, std::span<const Key> keys) {
+    for (auto key : keys) {
+      add(shard, key);
+    }
+  }
+
+  /// Replaces the keys of shard by those of filter, e.g. one that was
+  /// deserialized.  Throws std::logic_error unless filter has the
+  /// parameters of the shard set.
+  void assign(size_t shard, const Filter& filter) {
+    checkShard(shard);
+    const Impl& other = filter;
+    if (!layout.sameConfiguration(other)) {
+      throw std::logic_error{
+          "Only filters with the same configuration can be shards."};
+    }
+    for (size_t i = 0; i < layout.words; ++i) {
+      layout.filter[i * shards + shard] = other.loadWord(i);
+    }
+  }
+
+  Bitmap find(Key key) const {
+    Bitmap alive = allShards();
+    layout.forEachBit(key, [&](size_t word, UnderType mask) {
+      for (size_t g = 0; g < groups; ++g) {
+        if (alive[g] != 0) {
+          alive[g] &= bitsSet(word, mask, g);
+        }
+      }
+    });
+    return alive;
+  }
+
+  /// The shards that may hold a key in [lkey, hkey].  Follows findRange of
+  /// BloomRF, but every check carries the shards whose bits were set on
+  /// all layers above it, and is dropped once there are none.
+  Bitmap findRange(Key lkey, Key hkey) const {
+    if (lkey > hkey) {
+      throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
+    }
+    const Bitmap all = allShards();
+    Bitmap found(groups);
+    typename Impl::BlockCache blockCache(layout);
+
+    int layer = layout.hashes - 1;
+    // Adds the shards of reach that have a bit of check set to found.
+    // Returns whether all shards were found.
+    auto visitCovered = [&](const Bitmap& reach) {
+      return [&](const Check& check) {
+        layout.forEachCoveredWord(
+            check.low, check.high, layer,
+            blockCache.hashToWord(check.low, layer),
+            [&](size_t word, UnderType mask) {
+              for (size_t g = 0; g < groups; ++g) {
+                if ((reach[g] & ~found[g]) != 0) {
+                  found[g] |= reach[g] & bitsSet(word, mask, g);
+                }
+              }
+            });
+        return found == all;
+      };
+    };
+
+    typename Impl::Checks checks(lkey, hkey);
+    if (checks.initChecks(layout.shifts.back(), layout.delta.back(),
+                          visitCovered(all))) {
+      return found;
+    }
+    std::vector<std::pair<Check, Bitmap>> partial;
+    for (const auto& check : checks) {
+      partial.emplace_back(check, all);
+    }
+
+    while (layer > 0 && !partial.empty()) {
+      std::vector<std::pair<Check, Bitmap>> next;
+      --layer;
+      for (auto& [check, reach] : partial) {
+        auto [word, mask] = layout.wordToIndexAndBitMask(
+            check.low, layer + 1, blockCache.hashToWord(check.low, layer + 1));
+        bool any = false;
+        for (size_t g = 0; g < groups; ++g) {
+          reach[g] &= ~found[g];
+          if (reach[g] != 0) {
+            reach[g] &= bitsSet(word, mask, g);
+            any = any || reach[g] != 0;
+          }
+        }
+        if (!any) {
+          continue;
+        }
+        typename Impl::Checks newChecks(lkey, hkey);
+        if (newChecks.advanceCheck(check, layout.shifts[layer],
+                                   layout.delta[layer], visitCovered(reach))) {
+          return found;
+        }
+        for (const auto& newCheck : newChecks) {
+          next.emplace_back(newCheck, reach);
+        }
+      }
+      partial = std::move(next);
+    }
+    return found;
+  }
+
+  /// Size of the words of all shards in bytes.
+  size_t memoryBytes() const {
+    return layout.words * shards * sizeof(UnderType);
+  }
+
+ private:
+  /// Borrowed storage that keeps layout from allocating words of its own.
+  static typename Impl::Container placeholder() {
+    static UnderType word;
+    return typename Impl::Container(&word,
+                                    detail::FilterDeleter<UnderType>{false});
+  }
+
+  void checkShard(size_t shard) const {
+    if (shard >= shards) {
+      throw std::out_of_range{"No such shard."};
+    }
+  }
+
+  Bitmap allShards() const {
+    Bitmap bitmap(groups, ~uint64_t{0});
+    if (shards % 64 != 0) {
+      bitmap.back() = (uint64_t{1} << (shards % 64)) - 1;
+    }
+    return bitmap;
+  }
+
+  /// Bit j is set if word of shard 64 * group + j has a bit of mask set.
+  uint64_t bitsSet(size_t word, UnderType mask, size_t group) const {
+    const UnderType* first = &layout.filter[word * shards + 64 * group];
+    size_t n = std::min<size_t>(64, shards - 64 * group);
+    uint64_t bits = 0;
+    for (size_t j = 0; j < n; ++j) {
+      bits |= static_cast<uint64_t>((first[j] & mask) != 0) << j;
+    }
+    return bits;
+  }
+
+  Impl layout;
+  size_t shards;
+  /// Words of a bitmap.
+  size_t groups;
+};
+
+}  // namespace filters
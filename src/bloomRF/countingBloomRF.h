@@ -0,0 +1,114 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "bloomRF.h"
+
+namespace filters {
+
+//
+// A BloomRF whose keys can be removed again.  Every bit of the filter has a
+// 4-bit counter of the keys that set it, packed into UnderType words next to
+// the filter.  A bit is cleared when its counter drops to zero, so lookups
+// run on an ordinary BloomRF with the same PMHF layout, and findRange keeps
+// working.  The counters take four times the memory of the filter.
+//
+// A counter that reaches 15 sticks there and its bit is never cleared, so
+// an overloaded filter only loses the ability to forget keys.  Removing a
+// key that was not added may clear bits of other keys and cause false
+// negatives.  Not thread-safe.
+//
+template <typename Key, typename UnderType, typename HashPolicy>
+class CountingBloomRF {
+  using Filter = BloomRF<Key, UnderType, HashPolicy>;
+
+  static constexpr size_t WORD_BITS = 8 * sizeof(UnderType);
+  static constexpr size_t COUNTER_BITS = 4;
+  static constexpr size_t COUNTERS_PER_WORD = WORD_BITS / COUNTER_BITS;
+  static constexpr UnderType MAX_COUNT = (UnderType{1} << COUNTER_BITS) - 1;
+
+ public:
+  explicit CountingBloomRF(const BloomFilterRFParameters& params)
+      : filter(params),
+        counters(filter.numBits() / COUNTERS_PER_WORD) {}
+
+  void add(Key key) {
+    filter.forEachBit(key, [this](size_t word, UnderType mask) {
+      size_t bit = word * WORD_BITS + std::countr_zero(mask);
+      if (count(bit) < MAX_COUNT) {
+        counters[bit / COUNTERS_PER_WORD] += counterUnit(bit);
+      }
+      filter.getFilter()[word] |= mask;
+    });
+  }
+
+  void addBatch(std::span<const Key> keys) {
+    for (auto key : keys) {
+      add(key);
+    }
+  }
+
+  /// Removes one occurrence of a key that was added before.
+  void remove(Key key) {
+    filter.forEachBit(key, [this](size_t word, UnderType mask) {
+      size_t bit = word * WORD_BITS + std::countr_zero(mask);
+      UnderType c = count(bit);
+      if (c == 0 || c == MAX_COUNT) {
+        return;
+      }
+      counters[bit / COUNTERS_PER_WORD] -= counterUnit(bit);
+      if (c == 1) {
+        filter.getFilter()[word] &= ~mask;
+      }
+    });
+  }
+
+  void removeBatch(std::span<const Key> keys) {
+    for (auto key : keys) {
+      remove(key);
+    }
+  }
+
+  bool find(Key key) const { return filter.find(key); }
+
+  void findBatch(std::span<const Key> keys, bool* out) const {
+    filter.findBatch(keys, out);
+  }
+
+  bool findRange(Key lkey, Key hkey) const {
+    return filter.findRange(lkey, hkey);
+  }
+
+  void findRangeBatch(std::span<const std::pair<Key, Key>> ranges,
+                      bool* out) const {
+    filter.findRangeBatch(ranges, out);
+  }
+
+  /// The filter that lookups run on.
+  const Filter& getBloomRF() const { return filter; }
+
+  const auto& getFilter() const { return filter.getFilter(); }
+
+ private:
+  /// The counter of bit of the filter.
+  UnderType count(size_t bit) const {
+    return (counters[bit / COUNTERS_PER_WORD] >>
+            (bit % COUNTERS_PER_WORD * COUNTER_BITS)) &
+           MAX_COUNT;
+  }
+
+  /// One in the counter of bit within its word.
+  static UnderType counterUnit(size_t bit) {
+    return UnderType{1} << (bit % COUNTERS_PER_WORD * COUNTER_BITS);
+  }
+
+  Filter filter;
+  std::vector<UnderType> counters;
+};
+
+}  // namespace filters
@@ -0,0 +1,133 @@
+#include "filterMemory.h"
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+
+namespace filters {
+namespace detail {
+
+namespace {
+
+constexpr size_t MAX_NODES = 1024;
+
+#if defined(__linux__)
+[[noreturn]] void throwMapError(int err, void* addr, size_t length) {
+  if (addr != MAP_FAILED) {
+    ::munmap(addr, length);
+  }
+  throw std::system_error{err, std::generic_category(),
+                          "Cannot map the words of a filter"};
+}
+
+/// Binds or interleaves [addr, addr + length) on nodes.  Pages are placed
+/// when first touched, so this has to happen before the words are written.
+void place(void* addr, size_t length, const MemoryPolicy& policy) {
+  std::vector<unsigned long> mask(MAX_NODES / (8 * sizeof(unsigned long)));
+  for (int node : policy.nodes) {
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+  }
+  int mode = policy.numa == NumaPlacement::Bind ? MPOL_BIND : MPOL_INTERLEAVE;
+  // The kernel reads one bit less than maxnode.
+  if (::syscall(SYS_mbind, addr, length, mode, mask.data(), MAX_NODES + 1,
+                0) != 0) {
+    throwMapError(errno, addr, length);
+  }
+}
+#endif
+
+}  // namespace
+
+void* mapWords(size_t bytes, const MemoryPolicy& policy, size_t& length) {
+  if (policy.numa == NumaPlacement::FirstTouch) {
+    if (!policy.nodes.empty()) {
+      throw std::logic_error{"Nodes need a NUMA placement."};
+    }
+  } else if (policy.nodes.empty()) {
+    throw std::logic_error{"A NUMA placement needs at least one node."};
+  }
+  for (int node : policy.nodes) {
+    if (node < 0 || static_cast<size_t>(node) >= MAX_NODES) {
+      throw std::logic_error{"Invalid NUMA node."};
+    }
+  }
+
+#if defined(__linux__)
+  size_t pageSize = policy.pages == Pages::Default
+                        ? static_cast<size_t>(::sysconf(_SC_PAGESIZE))
+                        : HUGE_PAGE_SIZE;
+  length = (bytes + pageSize - 1) / pageSize * pageSize;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void* addr;
+  if (policy.pages == Pages::HugeTLB) {
+    // Huge TLB mappings are aligned to the huge page size.
+    addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB,
+                  -1, 0);
+    if (addr == MAP_FAILED) {
+      throwMapError(errno, addr, length);
+    }
+  } else if (policy.pages == Pages::Transparent) {
+    // Map a huge page more and unmap the ends, so that the words start at
+    // a huge page boundary.
+    size_t padded = length + HUGE_PAGE_SIZE;
+    void* raw =
+        ::mmap(nullptr, padded, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (raw == MAP_FAILED) {
+      throwMapError(errno, raw, padded);
+    }
+    auto begin = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned =
+        (begin + HUGE_PAGE_SIZE - 1) & ~uintptr_t{HUGE_PAGE_SIZE - 1};
+    if (aligned != begin) {
+      ::munmap(raw, aligned - begin);
+    }
+    if (aligned + length != begin + padded) {
+      ::munmap(reinterpret_cast<void*>(aligned + length),
+               begin + padded - (aligned + length));
+    }
+    addr = reinterpret_cast<void*>(aligned);
+    // Only advice: kernels without transparent huge pages fall back to
+    // 4 KiB pages.
+    ::madvise(addr, length, MADV_HUGEPAGE);
+  } else {
+    addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+      throwMapError(errno, addr, length);
+    }
+  }
+
+  if (policy.numa != NumaPlacement::FirstTouch) {
+    place(addr, length, policy);
+  }
+  return addr;
+#else
+  // Only the default policy, which allocateWords serves with operator new,
+  // is supported elsewhere.
+  (void)bytes;
+  length = 0;
+  throw std::logic_error{
+      "Huge pages and NUMA placement are only supported on Linux."};
+#endif
+}
+
+void unmapWords(void* words, size_t length) {
+#if defined(__linux__)
+  ::munmap(words, length);
+#else
+  // mapWords never maps anything here.
+  (void)words;
+  (void)length;
+#endif
+}
+
+}  // namespace detail
+}  // namespace filters
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace filters {
+
+/// Pages that back the words of a filter.
+enum class Pages : uint8_t {
+  /// operator new, so usually 4 KiB pages.
+  Default = 0,
+  /// An anonymous mapping aligned to 2 MiB that the kernel is advised to
+  /// back with transparent huge pages.  The kernel may still use 4 KiB pages,
+  /// e.g. if transparent huge pages are disabled.
+  Transparent = 1,
+  /// A MAP_HUGETLB mapping from the pool of reserved huge pages, see
+  /// /proc/sys/vm/nr_hugepages.  Allocation throws if the pool is too small.
+  HugeTLB = 2,
+};
+
+/// NUMA nodes that the words of a filter are placed on.
+enum class NumaPlacement : uint8_t {
+  /// The node of the thread that touches a page first, usually the one that
+  /// constructs the filter.
+  FirstTouch = 0,
+  /// Only the nodes of MemoryPolicy::nodes (MPOL_BIND).
+  Bind = 1,
+  /// Pages round-robin over the nodes of MemoryPolicy::nodes
+  /// (MPOL_INTERLEAVE), so that threads on all of them see the same
+  /// bandwidth and latency.
+  Interleave = 2,
+};
+
+/// How the words of a filter are allocated.  Probes of a large filter hit
+/// pages at random, so with 4 KiB pages nearly every probe misses the TLB,
+/// and huge pages cut those misses.  The default is plain operator new, and
+/// the only policy outside of Linux; others throw std::logic_error there.
+struct MemoryPolicy {
+  Pages pages = Pages::Default;
+  NumaPlacement numa = NumaPlacement::FirstTouch;
+  /// Nodes for NumaPlacement::Bind and NumaPlacement::Interleave.
+  std::vector<int> nodes;
+};
+
+namespace detail {
+
+/// Alignment of mappings with huge pages, the size of an x86-64 huge page.
+constexpr size_t HUGE_PAGE_SIZE = size_t{1} << 21;
+
+/// Maps at least bytes zeroed bytes as selected by policy, which must not be
+/// the default one.  Sets length to the length of the mapping.  Throws
+/// std::logic_error for invalid nodes or on platforms other than Linux, and
+/// std::system_error if the kernel refuses the mapping or the placement.
+void* mapWords(size_t bytes, const MemoryPolicy& policy, size_t& length);
+
+/// Frees a mapping of mapWords.
+void unmapWords(void* words, size_t length);
+
+}  // namespace detail
+
+}  // namespace filters
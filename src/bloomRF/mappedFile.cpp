@@ -0,0 +1,72 @@
+#include "mappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace filters {
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error{errno, std::generic_category(),
+                            "Cannot open " + path};
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error{err, std::generic_category(),
+                            "Cannot stat " + path};
+  }
+  if (st.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error{"Cannot map empty file " + path};
+  }
+
+  length = static_cast<size_t>(st.st_size);
+  addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  int err = errno;
+  // The mapping keeps the file referenced.
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    addr = nullptr;
+    throw std::system_error{err, std::generic_category(),
+                            "Cannot map " + path};
+  }
+  ::madvise(addr, length, MADV_RANDOM);
+}
+
+MappedFile::~MappedFile() {
+  unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : addr(std::exchange(other.addr, nullptr)),
+      length(std::exchange(other.length, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    unmap();
+    addr = std::exchange(other.addr, nullptr);
+    length = std::exchange(other.length, 0);
+  }
+  return *this;
+}
+
+void MappedFile::unmap() {
+  if (addr != nullptr) {
+    ::munmap(addr, length);
+    addr = nullptr;
+    length = 0;
+  }
+}
+
+}  // namespace filters
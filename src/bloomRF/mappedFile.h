@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+namespace filters {
+
+//
+// A read-only memory mapping of a whole file, e.g. of a serialized filter that
+// is queried through a BloomRFView.  Pages are faulted in on first access, and
+// the kernel is told to expect random access, which matches filter probes.
+//
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  size_t size() const { return length; }
+
+  std::span<const char> data() const {
+    return {static_cast<const char*>(addr), length};
+  }
+
+ private:
+  void unmap();
+
+  void* addr = nullptr;
+  size_t length = 0;
+};
+
+}  // namespace filters
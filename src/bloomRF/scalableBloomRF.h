@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bitRange.h"
+#include "bloomRF.h"
+
+namespace filters {
+
+struct ScalableBloomRFParameters {
+  /// The first generation.  Later generations only differ in size and in
+  /// a seed derived from seed and their number, and all of them reduce
+  /// hashes with IndexReduction::PowerOfTwo.
+  BloomFilterRFParameters initial;
+  /// Bits per key of the first generation, which is full once
+  /// 8 * filter_size / bits_per_key keys set new bits in it.
+  size_t bits_per_key = 16;
+  /// Every generation is growth times larger than the one before, a power
+  /// of two.
+  size_t growth = 2;
+  /// Every generation gets this many more bits per key than the one before,
+  /// so that the false positive rates of the generations fall and their sum
+  /// stays bounded.
+  size_t extra_bits_per_key = 2;
+};
+
+//
+// A BloomRF that grows as keys arrive, in the style of scalable Bloom
+// filters.  Keys go into the newest generation until it holds as many keys
+// as its bits per key allow.  Keys that the filter already finds, such as
+// repeated ones, set no new bits and are not counted.  Then a generation
+// growth times larger, with more bits per key and its own seed, is chained
+// behind it.  Lookups probe all generations, whose false positives are
+// independent, so the false positive rate stays bounded however far the
+// initial size was off.
+//
+// Generations reduce hashes with a mask, so a generation maps a key to the
+// same bits as the generation folded to half its size, ORing its halves.
+// compact() uses that to shrink the generations to the keys they hold,
+// which mostly frees the unused part of the newest one.  Layer sizes are not
+// supported, and the blocked layout needs an explicit blocked_layers so that
+// all generations block the same layers.  Not thread-safe.
+//
+template <typename Key, typename UnderType, typename HashPolicy>
+class ScalableBloomRF {
+  using Filter = BloomRF<Key, UnderType, HashPolicy>;
+
+  static constexpr size_t WORD_BITS = 8 * sizeof(UnderType);
+
+ public:
+  explicit ScalableBloomRF(const ScalableBloomRFParameters& params)
+      : params(params) {
+    if (!params.initial.layer_sizes.empty()) {
+      throw std::logic_error{"A scalable BloomRF cannot have layer sizes."};
+    }
+    if (params.initial.layout == Layout::Blocked &&
+        params.initial.blocked_layers == 0) {
+      throw std::logic_error{
+          "A scalable BloomRF needs an explicit number of blocked layers."};
+    }
+    if (params.growth < 2 || !std::has_single_bit(params.growth)) {
+      throw std::logic_error{"Growth has to be a power of two of at least 2."};
+    }
+    if (params.bits_per_key == 0) {
+      throw std::logic_error{"Bits per key cannot be zero."};
+    }
+    this->params.initial.reduction = IndexReduction::PowerOfTwo;
+    grow();
+  }
+
+  void add(Key key) {
+    makeRoom();
+    if (!find(key)) {
+      generations.back().filter.add(key);
+      ++generations.back().keys;
+    }
+  }
+
+  void addBatch(std::span<const Key> keys) {
+    while (!keys.empty()) {
+      makeRoom();
+      auto& newest = generations.back();
+      size_t n = std::min(keys.size(), newest.capacity - newest.keys);
+      std::vector<Key> unknown = unknownKeys(keys.first(n));
+      newest.filter.addBatch(unknown);
+      newest.keys += unknown.size();
+      keys = keys.subspan(n);
+    }
+  }
+
+  bool find(Key key) const {
+    return std::any_of(
+        generations.rbegin(), generations.rend(),
+        [&](const Generation& generation) {
+          return generation.filter.find(key);
+        });
+  }
+
+  bool findRange(Key lkey, Key hkey) const {
+    return std::any_of(
+        generations.rbegin(), generations.rend(),
+        [&](const Generation& generation) {
+          return generation.filter.findRange(lkey, hkey);
+        });
+  }
+
+  /// Adds the checks of every generation that was probed to stats.
+  bool findRange(Key lkey, Key hkey, QueryStats& stats) const {
+    return std::any_of(
+        generations.rbegin(), generations.rend(),
+        [&](const Generation& generation) {
+          return generation.filter.findRange(lkey, hkey, stats);
+        });
+  }
+
+  void findRangeBatch(std::span<const std::pair<Key, Key>> ranges,
+                      bool* out) const {
+    std::fill(out, out + ranges.size(), false);
+    std::unique_ptr<bool[]> found(new bool[ranges.size()]);
+    for (const auto& generation : generations) {
+      generation.filter.findRangeBatch(ranges, found.get());
+      for (size_t i = 0; i < ranges.size(); ++i) {
+        out[i] = out[i] || found[i];
+      }
+    }
+  }
+
+  /// Number of keys added that the filter did not find yet, which leaves
+  /// out repeated keys and false positives.
+  size_t size() const {
+    size_t keys = 0;
+    for (const auto& generation : generations) {
+      keys += generation.keys;
+    }
+    return keys;
+  }
+
+  size_t numGenerations() const { return generations.size(); }
+
+  const Filter& getGeneration(size_t i) const {
+    return generations.at(i).filter;
+  }
+
+  /// Keys in the newest generation relative to the keys it takes before the
+  /// next one is started.
+  double fillRatio() const {
+    const auto& newest = generations.back();
+    return static_cast<double>(newest.keys) / newest.capacity;
+  }
+
+  /// Size of all generations in bytes.
+  size_t memoryBytes() const {
+    size_t bits = 0;
+    for (const auto& generation : generations) {
+      bits += generation.filter.numBits();
+    }
+    return bits / 8;
+  }
+
+  /// Stops adding keys and folds every generation to its bits per key for
+  /// the keys it holds, rounded up to a power of two and no smaller than the
+  /// first generation.  Full generations keep their size, so this mostly
+  /// frees the unused part of the newest one, at its false positive rate.
+  /// The generations have their own seeds, so they cannot be folded into a
+  /// single filter.  add throws afterwards.
+  void compact() {
+    if (frozen) {
+      return;
+    }
+    frozen = true;
+
+    std::vector<Generation> compacted;
+    for (size_t g = 0; g < generations.size(); ++g) {
+      auto& generation = generations[g];
+      size_t bits = generation.keys * bitsPerKeyOf(g);
+      size_t words = std::bit_ceil(
+          std::max<size_t>(1, (bits + WORD_BITS - 1) / WORD_BITS));
+      size_t generationWords = wordsOf(generation);
+      words = std::clamp(words, wordsOf(generations.front()), generationWords);
+      if (words == generationWords) {
+        compacted.push_back(std::move(generation));
+        continue;
+      }
+
+      BloomFilterRFParameters folded = paramsOf(g);
+      folded.filter_size = words * sizeof(UnderType);
+      Generation target{Filter{folded}, generation.keys, generation.keys};
+      UnderType* targetWords = target.filter.getFilter().get();
+      const UnderType* from = generation.filter.getFilter().get();
+      for (size_t i = 0; i < generationWords; i += words) {
+        detail::combineWords(targetWords, from + i, words * sizeof(UnderType),
+                             detail::WordOp::Or);
+      }
+      compacted.push_back(std::move(target));
+    }
+    generations = std::move(compacted);
+  }
+
+  bool isFrozen() const { return frozen; }
+
+ private:
+  struct Generation {
+    Filter filter;
+    /// Keys added to the generation.
+    size_t keys;
+    /// Keys the generation takes.
+    size_t capacity;
+  };
+
+  static size_t wordsOf(const Generation& generation) {
+    return generation.filter.numBits() / WORD_BITS;
+  }
+
+  /// Starts a new generation if the newest one is full.
+  void makeRoom() {
+    if (frozen) {
+      throw std::logic_error{"Cannot add keys to a compacted filter."};
+    }
+    if (generations.back().keys >= generations.back().capacity) {
+      grow();
+    }
+  }
+
+  /// Parameters of generation i.
+  BloomFilterRFParameters paramsOf(size_t i) const {
+    BloomFilterRFParameters next = params.initial;
+    for (size_t j = 0; j < i; ++j) {
+      next.filter_size *= params.growth;
+    }
+    next.seed = params.initial.seed + i * detail::SEED_GEN_A;
+    return next;
+  }
+
+  size_t bitsPerKeyOf(size_t i) const {
+    return params.bits_per_key + i * params.extra_bits_per_key;
+  }
+
+  void grow() {
+    size_t i = generations.size();
+    Filter filter{paramsOf(i)};
+    size_t capacity = std::max<size_t>(1, filter.numBits() / bitsPerKeyOf(i));
+    generations.push_back({std::move(filter), 0, capacity});
+  }
+
+  /// The distinct keys that no generation finds.
+  std::vector<Key> unknownKeys(std::span<const Key> keys) const {
+    std::unique_ptr<bool[]> known(new bool[keys.size()]());
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+    for (const auto& generation : generations) {
+      generation.filter.findBatch(keys, found.get());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        known[i] = known[i] || found[i];
+      }
+    }
+    std::vector<Key> unknown;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (!known[i]) {
+        unknown.push_back(keys[i]);
+      }
+    }
+    std::sort(unknown.begin(), unknown.end());
+    unknown.erase(std::unique(unknown.begin(), unknown.end()), unknown.end());
+    return unknown;
+  }
+
+  ScalableBloomRFParameters params;
+  std::vector<Generation> generations;
+  bool frozen = false;
+};
+
+}  // namespace filters
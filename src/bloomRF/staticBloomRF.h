@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "bloomRF.h"
+
+namespace filters {
+
+//
+// A BloomRF whose delta vector is fixed at compile time.  The layer loops are
+// unrolled, the shifts are constants, whether a PMHF word fits an UnderType
+// is decided at compile time, and the divisions by word sizes become shifts.
+// The filter sets the same bits as BloomRF<Key, UnderType, HashPolicy> with
+// the flat layout, the same size, seed and delta vector.  Only unsigned
+// integer keys are supported.
+//
+template <typename Key, typename UnderType, typename HashPolicy, size_t... Delta>
+class BasicStaticBloomRF {
+  static_assert(std::is_unsigned_v<Key>);
+  static_assert(std::is_unsigned_v<UnderType>);
+  static_assert(sizeof...(Delta) > 0, "Delta vector cannot be empty.");
+  static_assert(((Delta > 0) && ...), "Delta vector cannot have zero values.");
+  static_assert((Delta + ...) <= 8 * sizeof(Key),
+                "Sum of delta vector should not exceed width of key.");
+
+  static constexpr size_t LAYERS = sizeof...(Delta);
+  static constexpr size_t WORD_BITS = 8 * sizeof(UnderType);
+
+ public:
+  static constexpr std::array<size_t, LAYERS> DELTA = {Delta...};
+
+  BasicStaticBloomRF(size_t filter_size, size_t seed_)
+      : seed(seed_),
+        words((filter_size + sizeof(UnderType) - 1) / sizeof(UnderType)) {
+    if (filter_size == 0) {
+      throw std::logic_error{"The size of bloom filter cannot be zero"};
+    }
+    for (size_t i = 0; i < LAYERS; ++i) {
+      pmhfWords[i] = (WORD_BITS * words) >> (DELTA[i] - 1);
+      if (pmhfWords[i] == 0) {
+        throw std::logic_error{
+            "The filter cannot be smaller than a PMHF word of a layer."};
+      }
+    }
+    filter = Container(new (std::align_val_t{detail::FILTER_ALIGNMENT})
+                           UnderType[words]{});
+  }
+
+  void add(Key key) {
+    forEachLayer([&]<size_t L>() {
+      auto [pos, mask] = wordAndMask<L>(key);
+      filter[pos] |= mask;
+      return true;
+    });
+  }
+
+  void addBatch(std::span<const Key> keys) {
+    for (auto key : keys) {
+      add(key);
+    }
+  }
+
+  bool find(Key key) const {
+    return forEachLayer([&]<size_t L>() { return probe<L>(key); });
+  }
+
+  bool findRange(Key lkey, Key hkey) const {
+    if (lkey > hkey) {
+      throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
+    }
+    return findInLayer<LAYERS - 1>(lkey, hkey, lkey, hkey);
+  }
+
+  const auto& getFilter() const { return filter; }
+
+ private:
+  using Container =
+      std::unique_ptr<UnderType[], detail::FilterDeleter<UnderType>>;
+
+  static constexpr std::array<size_t, LAYERS> SHIFTS = [] {
+    std::array<size_t, LAYERS> shifts{};
+    for (size_t i = 1; i < LAYERS; ++i) {
+      shifts[i] = shifts[i - 1] + DELTA[i - 1];
+    }
+    return shifts;
+  }();
+
+  /// Number of bits in a PMHF word of layer L.
+  template <size_t L>
+  static constexpr size_t PMHF_BITS = size_t{1} << (DELTA[L] - 1);
+
+  /// Calls fn.template operator()<L>() for L = 0, 1, ... while it returns
+  /// true, and returns whether it always did.
+  template <typename Fn>
+  static bool forEachLayer(Fn&& fn) {
+    return [&]<size_t... L>(std::index_sequence<L...>) {
+      return (fn.template operator()<L>() && ...);
+    }(std::make_index_sequence<LAYERS>{});
+  }
+
+  /// The PMHF word of layer L that key maps to.
+  template <size_t L>
+  size_t pmhfWord(Key key) const {
+    Key prefix = key >> (SHIFTS[L] + DELTA[L] - 1);
+    return HashPolicy::hash(prefix, seed, L) % pmhfWords[L];
+  }
+
+  /// The offset of key within its PMHF word of layer L.
+  template <size_t L>
+  static size_t offsetInPmhfWord(Key key) {
+    return (key >> SHIFTS[L]) & (PMHF_BITS<L> - 1);
+  }
+
+  /// The UnderType word and the bit of key on layer L.
+  template <size_t L>
+  std::pair<size_t, UnderType> wordAndMask(Key key) const {
+    size_t pos = pmhfWord<L>(key);
+    size_t offset = offsetInPmhfWord<L>(key);
+    if constexpr (PMHF_BITS<L> <= WORD_BITS) {
+      constexpr size_t pmhfWordsPerUT = WORD_BITS / PMHF_BITS<L>;
+      size_t bit = (pos % pmhfWordsPerUT) * PMHF_BITS<L> + offset;
+      return {pos / pmhfWordsPerUT, UnderType{1} << bit};
+    } else {
+      constexpr size_t utPerPmhfWord = PMHF_BITS<L> / WORD_BITS;
+      return {pos * utPerPmhfWord + offset / WORD_BITS,
+              UnderType{1} << (offset % WORD_BITS)};
+    }
+  }
+
+  /// Whether any bit of layer L is set for the intervals [low, high], which
+  /// lie in the same PMHF word.
+  template <size_t L>
+  bool anyBitInPmhfWord(Key low, Key high) const {
+    size_t pos = pmhfWord<L>(low);
+    size_t lowOffset = offsetInPmhfWord<L>(low);
+    size_t highOffset = offsetInPmhfWord<L>(high);
+    auto bitsFrom = [](size_t from, size_t to) {
+      UnderType mask = ~UnderType{0} << from;
+      if (to < WORD_BITS - 1) {
+        mask &= (UnderType{1} << (to + 1)) - 1;
+      }
+      return mask;
+    };
+
+    if constexpr (PMHF_BITS<L> <= WORD_BITS) {
+      constexpr size_t pmhfWordsPerUT = WORD_BITS / PMHF_BITS<L>;
+      size_t first = (pos % pmhfWordsPerUT) * PMHF_BITS<L>;
+      return (filter[pos / pmhfWordsPerUT] &
+              bitsFrom(first + lowOffset, first + highOffset)) != 0;
+    } else {
+      constexpr size_t utPerPmhfWord = PMHF_BITS<L> / WORD_BITS;
+      size_t lowWord = pos * utPerPmhfWord + lowOffset / WORD_BITS;
+      size_t highWord = pos * utPerPmhfWord + highOffset / WORD_BITS;
+      for (size_t w = lowWord; w <= highWord; ++w) {
+        size_t from = w == lowWord ? lowOffset % WORD_BITS : 0;
+        size_t to = w == highWord ? highOffset % WORD_BITS : WORD_BITS - 1;
+        if ((filter[w] & bitsFrom(from, to)) != 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+
+  /// Whether layer L, and the layers below it for intervals that straddle
+  /// lkey or hkey, hold a key of [lo, hi], a part of [lkey, hkey].
+  template <size_t L>
+  bool findInLayer(Key lo, Key hi, Key lkey, Key hkey) const {
+    constexpr size_t shift = SHIFTS[L];
+    constexpr Key width = Key{1} << shift;
+    Key first = lo >> shift;
+    Key last = hi >> shift;
+
+    // Only the first and the last interval can straddle the range.  Their
+    // bit on this layer only says that a key lies somewhere within them, so
+    // they are refined on the next lower layer.
+    auto isPartial = [&](Key interval) {
+      Key start = interval << shift;
+      return start < lkey || static_cast<Key>(start + (width - 1)) > hkey;
+    };
+    auto findInPartial = [&](Key interval) {
+      if constexpr (L == 0) {
+        // Intervals of the lowest layer are single keys.
+        return false;
+      } else {
+        Key start = interval << shift;
+        Key end = start + (width - 1);
+        return probe<L>(start) &&
+               findInLayer<L - 1>(std::max(start, lkey), std::min(end, hkey),
+                                  lkey, hkey);
+      }
+    };
+
+    if (isPartial(first)) {
+      if (findInPartial(first)) {
+        return true;
+      }
+      if (first == last) {
+        return false;
+      }
+      ++first;
+    }
+    if (first != last || !isPartial(last)) {
+      // The covered intervals, one PMHF word at a time.
+      Key coveredLast = isPartial(last) ? last - 1 : last;
+      for (Key interval = first;;) {
+        Key end = std::min<Key>(interval | (PMHF_BITS<L> - 1), coveredLast);
+        if (anyBitInPmhfWord<L>(interval << shift, end << shift)) {
+          return true;
+        }
+        if (end == coveredLast) {
+          break;
+        }
+        interval = end + 1;
+      }
+    }
+    return isPartial(last) && findInPartial(last);
+  }
+
+  /// Probes the bit of key on layer L only.
+  template <size_t L>
+  bool probe(Key key) const {
+    auto [pos, mask] = wordAndMask<L>(key);
+    return (filter[pos] & mask) != 0;
+  }
+
+  size_t seed;
+  size_t words;
+  /// Number of PMHF words of each layer.
+  std::array<size_t, LAYERS> pmhfWords;
+  Container filter;
+};
+
+template <typename Key, typename UnderType, size_t... Delta>
+using StaticBloomRF =
+    BasicStaticBloomRF<Key, UnderType, CityHashPolicy, Delta...>;
+
+}  // namespace filters
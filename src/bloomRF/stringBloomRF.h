@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bloomRF.h"
+
+namespace filters {
+
+/// Key type of a BloomRF over byte strings whose first Bytes bytes take
+/// part in range queries.  The keys themselves are std::string_view.
+template <size_t Bytes>
+struct BytePrefix {
+  static_assert(Bytes == 2 || Bytes == 4 || Bytes == 8 || Bytes == 16);
+};
+
+/// A plain Bloom filter over whole strings that point lookups of a string
+/// BloomRF consult besides the prefixes.  Without it, keys that share their
+/// first Bytes bytes cannot be told apart.  A filter_size of zero disables
+/// it.
+struct ExactKeyParameters {
+  size_t filter_size = 0;
+  size_t hashes = 3;
+};
+
+namespace detail {
+
+/// The first sizeof(UnsignedKey) bytes of data as a big-endian integer,
+/// padded with zero bytes, so that integers compare like the strings.
+template <typename UnsignedKey>
+UnsignedKey bigEndianPrefix(std::string_view data) {
+  unsigned char bytes[sizeof(UnsignedKey)] = {};
+  std::copy_n(data.data(), std::min(data.size(), sizeof(UnsignedKey)), bytes);
+  UnsignedKey key = 0;
+  for (auto byte : bytes) {
+    key = static_cast<UnsignedKey>(key << 8) | byte;
+  }
+  return key;
+}
+
+}  // namespace detail
+
+//
+// BloomRF over variable-length byte strings, such as the keys of an LSM
+// tree.  Every string is mapped to its first Bytes bytes as a big-endian
+// integer.  That mapping is monotone in the lexicographic order, so a range
+// of strings is the range of prefixes between its ends, and findRange and
+// findPrefix never miss a key.  Strings that share their first Bytes bytes
+// share their prefix, so the resolution of range queries ends there.
+//
+// Point lookups alone would then confuse such strings too.  ExactKeyParameters
+// adds a Bloom filter over whole strings that find also has to pass, so that
+// one filter serves both point lookups and seeks.  Not serializable.
+//
+template <size_t Bytes, typename UnderType, typename HashPolicy>
+class BloomRF<BytePrefix<Bytes>, UnderType, HashPolicy>
+    : private detail::BloomRfImpl<detail::UIntOfBits<8 * Bytes>,
+                                  UnderType,
+                                  HashPolicy> {
+  using UnsignedKey = detail::UIntOfBits<8 * Bytes>;
+  using Impl = detail::BloomRfImpl<UnsignedKey, UnderType, HashPolicy>;
+
+  static constexpr size_t WORD_BITS = 8 * sizeof(UnderType);
+
+  static UnsignedKey toUnsigned(std::string_view data) {
+    return detail::bigEndianPrefix<UnsignedKey>(data);
+  }
+
+ public:
+  explicit BloomRF(const BloomFilterRFParameters& params,
+                   const ExactKeyParameters& exact = {})
+      : Impl(params),
+        seed(params.seed),
+        exactHashes(exact.hashes),
+        exactWords((exact.filter_size + sizeof(UnderType) - 1) /
+                   sizeof(UnderType)) {
+    if (!exactWords.empty() && exactHashes == 0) {
+      throw std::logic_error{"An exact key filter needs at least one hash."};
+    }
+  }
+
+  void add(std::string_view data) {
+    Impl::add(toUnsigned(data));
+    forEachExactBit(data, [this](size_t word, UnderType mask) {
+      exactWords[word] |= mask;
+    });
+  }
+
+  void addBatch(std::span<const std::string_view> data) {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned, [this](std::span<const UnsignedKey> block, size_t) {
+          Impl::addBatch(block);
+        });
+    for (auto key : data) {
+      forEachExactBit(key, [this](size_t word, UnderType mask) {
+        exactWords[word] |= mask;
+      });
+    }
+  }
+
+  void addConcurrent(std::string_view data) {
+    Impl::addConcurrent(toUnsigned(data));
+    forEachExactBit(data, [this](size_t word, UnderType mask) {
+      std::atomic_ref<UnderType>(exactWords[word])
+          .fetch_or(mask, std::memory_order_relaxed);
+    });
+  }
+
+  void addBatchConcurrent(std::span<const std::string_view> data) {
+    for (auto key : data) {
+      addConcurrent(key);
+    }
+  }
+
+  void addBatchParallel(std::span<const std::string_view> data,
+                        size_t threads = detail::defaultThreads()) {
+    detail::forEachSliceInParallel(
+        data.size(), threads, [this, data](size_t begin, size_t end) {
+          addBatchConcurrent(data.subspan(begin, end - begin));
+        });
+  }
+
+  bool find(std::string_view data) const {
+    return Impl::find(toUnsigned(data)) && findExact(data);
+  }
+
+  void findBatch(std::span<const std::string_view> data, bool* out) const {
+    detail::forEachConvertedBlock<UnsignedKey>(
+        data, toUnsigned,
+        [this, out](std::span<const UnsignedKey> block, size_t offset) {
+          Impl::findBatch(block, out + offset);
+        });
+    for (size_t i = 0; i < data.size(); ++i) {
+      out[i] = out[i] && findExact(data[i]);
+    }
+  }
+
+  /// Whether the filter may hold a string between lkey and hkey in
+  /// lexicographic order.
+  bool findRange(std::string_view lkey, std::string_view hkey) const {
+    if (lkey > hkey) {
+      throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
+    }
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey));
+  }
+
+  bool findRange(std::string_view lkey,
+                 std::string_view hkey,
+                 QueryStats& stats) const {
+    if (lkey > hkey) {
+      throw std::logic_error{"lkey < hkey must hold for findRange arguments."};
+    }
+    return Impl::findRange(toUnsigned(lkey), toUnsigned(hkey), stats);
+  }
+
+  void findRangeBatch(
+      std::span<const std::pair<std::string_view, std::string_view>> ranges,
+      bool* out) const {
+    std::vector<std::pair<UnsignedKey, UnsignedKey>> converted(ranges.size());
+    std::transform(ranges.begin(), ranges.end(), converted.begin(),
+                   [](const auto& range) {
+                     if (range.first > range.second) {
+                       throw std::logic_error{
+                           "lkey < hkey must hold for findRange arguments."};
+                     }
+                     return std::pair{toUnsigned(range.first),
+                                      toUnsigned(range.second)};
+                   });
+    Impl::findRangeBatch(converted, out);
+  }
+
+  /// Whether the filter may hold a string that starts with prefix.
+  bool findPrefix(std::string_view prefix) const {
+    auto [low, high] = prefixRange(prefix);
+    return Impl::findRange(low, high);
+  }
+
+  using Impl::getDelta;
+  using Impl::getFilter;
+
+  const std::vector<UnderType>& getExactFilter() const { return exactWords; }
+
+  void mergeFrom(const BloomRF& other) {
+    checkExactCompatible(other);
+    Impl::mergeFrom(other);
+    detail::combineWords(exactWords.data(), other.exactWords.data(),
+                         exactWords.size() * sizeof(UnderType),
+                         detail::WordOp::Or);
+  }
+
+  void intersect(const BloomRF& other) {
+    checkExactCompatible(other);
+    Impl::intersect(other);
+    detail::combineWords(exactWords.data(), other.exactWords.data(),
+                         exactWords.size() * sizeof(UnderType),
+                         detail::WordOp::And);
+  }
+
+ private:
+  /// The range of prefixes of the strings that start with prefix.
+  static std::pair<UnsignedKey, UnsignedKey> prefixRange(
+      std::string_view prefix) {
+    UnsignedKey low = toUnsigned(prefix);
+    if (prefix.size() >= Bytes) {
+      return {low, low};
+    }
+    UnsignedKey rest = std::numeric_limits<UnsignedKey>::max() >>
+                       (8 * prefix.size());
+    return {low, static_cast<UnsignedKey>(low | rest)};
+  }
+
+  /// Calls fn(word, mask) for every bit of the exact key filter of data.
+  template <typename Fn>
+  void forEachExactBit(std::string_view data, Fn fn) const {
+    if (exactWords.empty()) {
+      return;
+    }
+    uint64_t hash1 = CityHash64WithSeed(data.data(), data.size(), seed);
+    uint64_t hash2 = CityHash64WithSeed(
+        data.data(), data.size(),
+        detail::SEED_GEN_A * seed + detail::SEED_GEN_B);
+    size_t bits = exactWords.size() * WORD_BITS;
+    for (size_t i = 0; i < exactHashes; ++i) {
+      size_t bit = (hash1 + i * hash2 + i * i) % bits;
+      fn(bit / WORD_BITS, UnderType{1} << (bit % WORD_BITS));
+    }
+  }
+
+  /// Reads words with relaxed atomic loads, like the prefix filter, so that
+  /// lookups may run concurrently with addConcurrent.
+  bool findExact(std::string_view data) const {
+    bool found = true;
+    forEachExactBit(data, [this, &found](size_t word, UnderType mask) {
+      found = found &&
+              (std::atomic_ref<UnderType>(
+                   const_cast<UnderType&>(exactWords[word]))
+                   .load(std::memory_order_relaxed) &
+               mask);
+    });
+    return found;
+  }
+
+  void checkExactCompatible(const BloomRF& other) const {
+    if (exactHashes != other.exactHashes ||
+        exactWords.size() != other.exactWords.size()) {
+      throw std::logic_error{
+          "Only filters with the same configuration can be combined."};
+    }
+  }
+
+  size_t seed;
+  size_t exactHashes;
+  std::vector<UnderType> exactWords;
+};
+
+//
+// BloomRF<std::string_view> ranges over the first 8 bytes of its keys, which
+// BloomRF<BytePrefix<16>> widens to 16.
+//
+template <typename UnderType, typename HashPolicy>
+class BloomRF<std::string_view, UnderType, HashPolicy>
+    : public BloomRF<BytePrefix<8>, UnderType, HashPolicy> {
+ public:
+  using BloomRF<BytePrefix<8>, UnderType, HashPolicy>::BloomRF;
+};
+
+}  // namespace filters
@@ -0,0 +1,196 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "bloomRF/bloomRF.h"
+
+//
+// Microbenchmarks of the hot paths of BloomRF.  Unlike experiments, which
+// also measures false positive rates, these only time add, find and
+// findRange on pregenerated keys, so that runs can be compared with
+// benchmark's compare.py.
+//
+//   bench_bloomrf --benchmark_filter='Find<uint64_t, uint64_t>'
+//
+// Filters are sized from L1 resident (16 KiB) to far beyond the last level
+// cache (128 MiB) and filled with 16 bits per key.
+//
+
+namespace {
+
+using filters::BloomFilterRFParameters;
+using filters::BloomRF;
+
+/// Number of pregenerated keys, a power of two.
+constexpr size_t KEYS = 1 << 16;
+
+constexpr size_t BITS_PER_KEY = 16;
+
+const std::vector<int64_t> FILTER_BYTES{1 << 14, 1 << 18, 1 << 22, 1 << 26,
+                                        1 << 27};
+const std::vector<int64_t> RANGE_WIDTHS{1, 1 << 4, 1 << 10, 1 << 16, 1 << 24};
+
+/// A delta vector that fits the width of Key.
+template <typename Key>
+std::vector<size_t> deltaFor() {
+  if constexpr (sizeof(Key) == 2) {
+    return {4, 4, 4, 2, 2};
+  } else if constexpr (sizeof(Key) == 4) {
+    return {7, 7, 6, 4, 4, 2, 2};
+  } else {
+    return {7, 7, 7, 4, 4, 2, 2, 2};
+  }
+}
+
+/// Keys spread over the whole domain of integers and over [-1e6, 1e6] for
+/// floating point keys.
+template <typename Key>
+std::vector<Key> randomKeys(size_t n, uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::vector<Key> keys(n);
+  if constexpr (std::is_floating_point_v<Key>) {
+    std::uniform_real_distribution<Key> dist(-1e6, 1e6);
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  } else {
+    std::uniform_int_distribution<Key> dist(std::numeric_limits<Key>::min(),
+                                            std::numeric_limits<Key>::max());
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  }
+  return keys;
+}
+
+/// Returns [low, low + width], clamped to the domain of Key.
+template <typename Key>
+std::pair<Key, Key> rangeFrom(Key low, int64_t width) {
+  if constexpr (std::is_floating_point_v<Key>) {
+    return {low, low + static_cast<Key>(width)};
+  } else {
+    Key high = low + static_cast<Key>(width);
+    return {low, high < low ? std::numeric_limits<Key>::max() : high};
+  }
+}
+
+/// The filter that Find and FindRange last ran on.  Filling the large ones
+/// takes seconds, so a filter is kept for all benchmarks that run on it in
+/// a row, but no longer, since the large ones take a lot of memory.
+struct FilledFilter {
+  const std::type_info* type = nullptr;
+  size_t bytes = 0;
+  std::shared_ptr<void> filter;
+};
+FilledFilter filled;
+
+/// Returns a filter of filterBytes filled with filterBytes * 8 /
+/// BITS_PER_KEY keys.
+template <typename Key, typename UnderType>
+const BloomRF<Key, UnderType>& filledFilter(size_t filterBytes) {
+  using Filter = BloomRF<Key, UnderType>;
+  if (filled.type != &typeid(Filter) || filled.bytes != filterBytes) {
+    filled.filter.reset();
+    auto bf = std::make_shared<Filter>(
+        BloomFilterRFParameters{filterBytes, 0, deltaFor<Key>()});
+    size_t n = filterBytes * 8 / BITS_PER_KEY;
+    for (size_t begin = 0; begin < n; begin += KEYS) {
+      bf->addBatch(randomKeys<Key>(std::min(KEYS, n - begin), begin + 1));
+    }
+    filled = {&typeid(Filter), filterBytes, std::move(bf)};
+  }
+  return *static_cast<const Filter*>(filled.filter.get());
+}
+
+template <typename Key, typename UnderType>
+void Add(benchmark::State& state) {
+  BloomRF<Key, UnderType> bf{BloomFilterRFParameters{
+      static_cast<size_t>(state.range(0)), 0, deltaFor<Key>()}};
+  auto keys = randomKeys<Key>(KEYS, 2);
+  size_t i = 0;
+  for (auto _ : state) {
+    bf.add(keys[i++ & (KEYS - 1)]);
+  }
+  benchmark::DoNotOptimize(bf.getFilter().get());
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Key, typename UnderType>
+void AddBatch(benchmark::State& state) {
+  BloomRF<Key, UnderType> bf{BloomFilterRFParameters{
+      static_cast<size_t>(state.range(0)), 0, deltaFor<Key>()}};
+  auto keys = randomKeys<Key>(KEYS, 2);
+  for (auto _ : state) {
+    bf.addBatch(keys);
+  }
+  benchmark::DoNotOptimize(bf.getFilter().get());
+  state.SetItemsProcessed(state.iterations() * KEYS);
+}
+
+template <typename Key, typename UnderType>
+void Find(benchmark::State& state) {
+  const auto& bf = filledFilter<Key, UnderType>(state.range(0));
+  auto queries = randomKeys<Key>(KEYS, 3);
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(bf.find(queries[i++ & (KEYS - 1)]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Key, typename UnderType>
+void FindRange(benchmark::State& state) {
+  const auto& bf = filledFilter<Key, UnderType>(state.range(0));
+  std::vector<std::pair<Key, Key>> queries;
+  for (auto low : randomKeys<Key>(KEYS, 3)) {
+    queries.push_back(rangeFrom(low, state.range(1)));
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    const auto& [low, high] = queries[i++ & (KEYS - 1)];
+    benchmark::DoNotOptimize(bf.findRange(low, high));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void filterSizes(benchmark::internal::Benchmark* b) {
+  for (auto bytes : FILTER_BYTES) {
+    b->Arg(bytes);
+  }
+}
+
+/// All widths for one size before the next, so that each filter is filled
+/// once.
+void filterSizesAndWidths(benchmark::internal::Benchmark* b) {
+  for (auto bytes : FILTER_BYTES) {
+    for (auto width : RANGE_WIDTHS) {
+      b->Args({bytes, width});
+    }
+  }
+}
+
+#define BLOOMRF_BENCHMARKS(Key, UnderType)                                   \
+  BENCHMARK_TEMPLATE(Add, Key, UnderType)->Apply(filterSizes);               \
+  BENCHMARK_TEMPLATE(AddBatch, Key, UnderType)->Apply(filterSizes);          \
+  BENCHMARK_TEMPLATE(Find, Key, UnderType)->Apply(filterSizes);              \
+  BENCHMARK_TEMPLATE(FindRange, Key, UnderType)->Apply(filterSizesAndWidths)
+
+BLOOMRF_BENCHMARKS(uint16_t, uint64_t);
+BLOOMRF_BENCHMARKS(uint32_t, uint64_t);
+BLOOMRF_BENCHMARKS(uint64_t, uint64_t);
+BLOOMRF_BENCHMARKS(uint64_t, uint32_t);
+BLOOMRF_BENCHMARKS(int32_t, uint64_t);
+BLOOMRF_BENCHMARKS(int64_t, uint64_t);
+BLOOMRF_BENCHMARKS(int64_t, uint32_t);
+BLOOMRF_BENCHMARKS(float, uint64_t);
+BLOOMRF_BENCHMARKS(double, uint64_t);
+BLOOMRF_BENCHMARKS(double, uint32_t);
+
+}  // namespace
+
+BENCHMARK_MAIN();
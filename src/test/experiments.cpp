@@ -1,14 +1,32 @@
 
 #include "experiments.h"
+#include "bloomRF/advisor.h"
+#include "bloomRF/bitRange.h"
+#include "bloomRF/bloomRFShardSet.h"
+#include "bloomRF/staticBloomRF.h"
 #include "city/city.h"
 
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <bit>
 #include <chrono>
 #include <cstddef>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <type_traits>
 
 namespace {
@@ -65,6 +83,783 @@ void runPointExperiments(std::function<T()> d,
   std::cout << "------------------------" << std::endl;
 }
 
+template <typename T>
+void runBatchExperiments(std::function<T()> d, const std::string& msg) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: " << msg << std::endl;
+
+  std::vector<T> keys(2000000);
+  std::generate(keys.begin(), keys.end(), d);
+
+  BloomFilterRFParameters params{4000000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  BloomRF<T> scalar{params};
+  BloomRF<T> batched{params};
+
+  auto t1 = high_resolution_clock::now();
+  for (const auto& key : keys) {
+    scalar.add(key);
+  }
+  auto t2 = high_resolution_clock::now();
+  batched.addBatch(keys);
+  auto t3 = high_resolution_clock::now();
+
+  duration<double, std::milli> scalar_ms = t2 - t1;
+  duration<double, std::milli> batched_ms = t3 - t2;
+  std::cout << "time for 2000000 adds: " << scalar_ms.count() << "ms\n";
+  std::cout << "time for addBatch of 2000000 keys: " << batched_ms.count()
+            << "ms\n";
+
+  std::vector<T> queries(100000);
+  std::generate(queries.begin(), queries.end(), d);
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  size_t found = 0;
+
+  t1 = high_resolution_clock::now();
+  for (const auto& query : queries) {
+    found += batched.find(query);
+  }
+  t2 = high_resolution_clock::now();
+  batched.findBatch(queries, out.get());
+  t3 = high_resolution_clock::now();
+
+  scalar_ms = t2 - t1;
+  batched_ms = t3 - t2;
+  std::cout << "time for 100000 point queries: " << scalar_ms.count()
+            << "ms (" << found << " positives)\n";
+  std::cout << "time for findBatch of 100000 keys: " << batched_ms.count()
+            << "ms\n";
+
+  std::vector<std::pair<T, T>> ranges(queries.size());
+  std::transform(queries.begin(), queries.end(), ranges.begin(),
+                 [](T low) { return std::pair<T, T>{low, low + 100000}; });
+  found = 0;
+
+  t1 = high_resolution_clock::now();
+  for (const auto& [low, high] : ranges) {
+    found += batched.findRange(low, high);
+  }
+  t2 = high_resolution_clock::now();
+  batched.findRangeBatch(ranges, out.get());
+  t3 = high_resolution_clock::now();
+
+  scalar_ms = t2 - t1;
+  batched_ms = t3 - t2;
+  std::cout << "time for 100000 range queries: " << scalar_ms.count()
+            << "ms (" << found << " positives)\n";
+  std::cout << "time for findRangeBatch of 100000 ranges: "
+            << batched_ms.count() << "ms\n";
+  std::cout << "------------------------" << std::endl;
+}
+
+template <typename HashPolicy>
+void runHashExperiments(
+    std::function<uint64_t()> d,
+    std::function<uint64_t()> qkg,
+    const std::string& msg,
+    filters::IndexReduction reduction = filters::IndexReduction::Modulo) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: " << msg << std::endl;
+
+  std::vector<uint64_t> keys(2000000);
+  std::generate(keys.begin(), keys.end(), d);
+  std::vector<uint64_t> queries(1000000);
+  std::generate(queries.begin(), queries.end(), qkg);
+
+  BloomFilterRFParameters pointParams{3200000, 0, {8, 8, 6, 6, 5, 5, 4, 3}};
+  BloomFilterRFParameters rangeParams{4000000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  pointParams.reduction = reduction;
+  rangeParams.reduction = reduction;
+  BloomRF<uint64_t, uint64_t, HashPolicy> point{pointParams};
+  BloomRF<uint64_t, uint64_t, HashPolicy> range{rangeParams};
+
+  auto t1 = high_resolution_clock::now();
+  for (const auto& key : keys) {
+    point.add(key);
+  }
+  auto t2 = high_resolution_clock::now();
+  std::vector<bool> pointResults;
+  pointResults.reserve(queries.size());
+  for (const auto& query : queries) {
+    pointResults.push_back(point.find(query));
+  }
+  auto t3 = high_resolution_clock::now();
+
+  range.addBatch(keys);
+  auto t4 = high_resolution_clock::now();
+  std::vector<bool> rangeResults;
+  rangeResults.reserve(queries.size());
+  for (const auto& query : queries) {
+    uint64_t high = query + 100000000;
+    rangeResults.push_back(range.findRange(
+        query, high < query ? std::numeric_limits<uint64_t>::max() : high));
+  }
+  auto t5 = high_resolution_clock::now();
+
+  // Ground truth is computed outside of the timed sections.
+  std::sort(keys.begin(), keys.end());
+  size_t point_fp = 0, point_negatives = 0, range_fp = 0, range_negatives = 0;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    uint64_t high = queries[i] + 100000000;
+    if (high < queries[i]) high = std::numeric_limits<uint64_t>::max();
+    if (!std::binary_search(keys.begin(), keys.end(), queries[i])) {
+      ++point_negatives;
+      point_fp += pointResults[i];
+    }
+    auto lb = std::lower_bound(keys.begin(), keys.end(), queries[i]);
+    if (lb == keys.end() || *lb > high) {
+      ++range_negatives;
+      range_fp += rangeResults[i];
+    }
+  }
+
+  duration<double, std::milli> insert_ms = t2 - t1;
+  duration<double, std::milli> point_ms = t3 - t2;
+  duration<double, std::milli> range_ms = t5 - t4;
+  std::cout << "time for 2000000 adds: " << insert_ms.count() << "ms\n";
+  std::cout << "time for 1000000 point queries: " << point_ms.count()
+            << "ms, fpr: "
+            << static_cast<double>(point_fp) / point_negatives << "\n";
+  std::cout << "time for 1000000 range queries of size 1e8: "
+            << range_ms.count() << "ms, fpr: "
+            << static_cast<double>(range_fp) / range_negatives << "\n";
+  std::cout << "------------------------" << std::endl;
+}
+
+void runLayoutExperiments(size_t numKeys,
+                          size_t bitsPerKey,
+                          filters::Layout layout,
+                          std::function<uint64_t()> d,
+                          const std::string& msg) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: " << msg << std::endl;
+
+  std::vector<uint64_t> keys(numKeys);
+  std::generate(keys.begin(), keys.end(), d);
+  std::vector<uint64_t> queries(1000000);
+  std::generate(queries.begin(), queries.end(), d);
+
+  size_t filterSize = numKeys * bitsPerKey / 8;
+  BloomRF<uint64_t> point{BloomFilterRFParameters{
+      filterSize, 0, {8, 8, 6, 6, 5, 5, 4, 3}, layout}};
+  BloomRF<uint64_t> range{BloomFilterRFParameters{
+      filterSize, 0, {7, 7, 7, 4, 4, 2, 2, 2}, layout}};
+
+  auto t1 = high_resolution_clock::now();
+  for (const auto& key : keys) {
+    point.add(key);
+  }
+  auto t2 = high_resolution_clock::now();
+  std::vector<bool> pointResults;
+  pointResults.reserve(queries.size());
+  for (const auto& query : queries) {
+    pointResults.push_back(point.find(query));
+  }
+  auto t3 = high_resolution_clock::now();
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  point.findBatch(queries, out.get());
+  auto t4 = high_resolution_clock::now();
+
+  range.addBatch(keys);
+  auto t5 = high_resolution_clock::now();
+  std::vector<bool> rangeResults;
+  rangeResults.reserve(queries.size());
+  for (const auto& query : queries) {
+    uint64_t high = query + 100000000;
+    rangeResults.push_back(range.findRange(
+        query, high < query ? std::numeric_limits<uint64_t>::max() : high));
+  }
+  auto t6 = high_resolution_clock::now();
+
+  std::sort(keys.begin(), keys.end());
+  size_t point_fp = 0, point_negatives = 0, range_fp = 0, range_negatives = 0;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    uint64_t high = queries[i] + 100000000;
+    if (high < queries[i]) high = std::numeric_limits<uint64_t>::max();
+    if (!std::binary_search(keys.begin(), keys.end(), queries[i])) {
+      ++point_negatives;
+      point_fp += pointResults[i];
+    }
+    auto lb = std::lower_bound(keys.begin(), keys.end(), queries[i]);
+    if (lb == keys.end() || *lb > high) {
+      ++range_negatives;
+      range_fp += rangeResults[i];
+    }
+  }
+
+  duration<double, std::milli> insert_ms = t2 - t1;
+  duration<double, std::milli> point_ms = t3 - t2;
+  duration<double, std::milli> batch_ms = t4 - t3;
+  duration<double, std::milli> range_ms = t6 - t5;
+  std::cout << "time for " << numKeys << " adds: " << insert_ms.count()
+            << "ms\n";
+  std::cout << "time for 1000000 point queries: " << point_ms.count()
+            << "ms, fpr: "
+            << static_cast<double>(point_fp) / point_negatives << "\n";
+  std::cout << "time for findBatch of 1000000 keys: " << batch_ms.count()
+            << "ms\n";
+  std::cout << "time for 1000000 range queries of size 1e8: "
+            << range_ms.count() << "ms, fpr: "
+            << static_cast<double>(range_fp) / range_negatives << "\n";
+  std::cout << "------------------------" << std::endl;
+}
+
+void runBitRangeExperiments() {
+  using filters::detail::SimdLevel;
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: any bit in range kernels" << std::endl;
+
+  // Sparse, L1 resident words, so that most spans are tested up to their
+  // last word, as for the empty dyadic intervals of a range query.
+  std::mt19937_64 gen(1);
+  std::vector<uint64_t> words(1 << 12);
+  for (auto& word : words) {
+    word = gen() % 16 == 0 ? uint64_t{1} << (gen() % 64) : 0;
+  }
+
+  std::vector<std::pair<std::string, SimdLevel>> levels{
+      {"scalar", SimdLevel::Scalar}};
+  if (filters::detail::supportedSimdLevel() >= SimdLevel::Avx2) {
+    levels.emplace_back("avx2", SimdLevel::Avx2);
+  }
+  if (filters::detail::supportedSimdLevel() >= SimdLevel::Avx512) {
+    levels.emplace_back("avx512", SimdLevel::Avx512);
+  }
+
+  for (size_t span : {2, 4, 8, 16, 32}) {
+    std::vector<std::pair<size_t, size_t>> ranges(1000000);
+    for (auto& [low, high] : ranges) {
+      low = (gen() % (words.size() - span)) * 64 + gen() % 64;
+      high = low + (span - 1) * 64;
+    }
+    for (const auto& [name, level] : levels) {
+      size_t found = 0;
+      auto t1 = high_resolution_clock::now();
+      for (const auto& [low, high] : ranges) {
+        found +=
+            filters::detail::anyBitInRange(words.data(), low, high, level);
+      }
+      auto t2 = high_resolution_clock::now();
+      duration<double, std::milli> ms = t2 - t1;
+      std::cout << "time for 1000000 spans of " << span << " words, " << name
+                << ": " << ms.count() << "ms (" << found << " set)\n";
+    }
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+void runParallelBuildExperiments(size_t numKeys) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: parallel build of a sorted run of "
+            << numKeys << " keys" << std::endl;
+
+  std::mt19937_64 gen(1);
+  std::vector<uint64_t> keys(numKeys);
+  std::generate(keys.begin(), keys.end(), gen);
+  std::sort(keys.begin(), keys.end());
+  BloomFilterRFParameters params{numKeys * 2, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+
+  auto time = [&](const std::string& name, auto build) {
+    BloomRF<uint64_t> bf{params};
+    auto t1 = high_resolution_clock::now();
+    build(bf);
+    auto t2 = high_resolution_clock::now();
+    duration<double, std::milli> ms = t2 - t1;
+    std::cout << "time for " << name << ": " << ms.count() << "ms\n";
+  };
+
+  time("add", [&](BloomRF<uint64_t>& bf) {
+    for (auto key : keys) {
+      bf.add(key);
+    }
+  });
+  time("addBatch", [&](BloomRF<uint64_t>& bf) { bf.addBatch(keys); });
+  time("addBatchConcurrent",
+       [&](BloomRF<uint64_t>& bf) { bf.addBatchConcurrent(keys); });
+  for (size_t threads = 1; threads <= filters::detail::defaultThreads();
+       threads *= 2) {
+    time("addBatchParallel with " + std::to_string(threads) + " threads",
+         [&](BloomRF<uint64_t>& bf) { bf.addBatchParallel(keys, threads); });
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Compares building the filter of two merged runs of numKeys keys each by
+/// adding all keys with merging the filters of the runs.
+void runMergeExperiments(size_t numKeys) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: merging the filters of two runs of "
+            << numKeys << " keys" << std::endl;
+
+  std::mt19937_64 gen(1);
+  std::vector<uint64_t> keys(2 * numKeys);
+  std::generate(keys.begin(), keys.end(), gen);
+  std::span<const uint64_t> first(keys.data(), numKeys);
+  std::span<const uint64_t> second(keys.data() + numKeys, numKeys);
+  BloomFilterRFParameters params{keys.size() * 2, 0,
+                                 {7, 7, 7, 4, 4, 2, 2, 2}};
+
+  BloomRF<uint64_t> rebuilt{params};
+  auto t1 = high_resolution_clock::now();
+  rebuilt.addBatch(keys);
+  auto t2 = high_resolution_clock::now();
+
+  BloomRF<uint64_t> merged{params};
+  BloomRF<uint64_t> other{params};
+  merged.addBatch(first);
+  other.addBatch(second);
+  auto t3 = high_resolution_clock::now();
+  merged.mergeFrom(other);
+  auto t4 = high_resolution_clock::now();
+
+  duration<double, std::milli> rebuild_ms = t2 - t1;
+  duration<double, std::milli> merge_ms = t4 - t3;
+  std::cout << "time for addBatch of " << keys.size()
+            << " keys: " << rebuild_ms.count() << "ms\n";
+  std::cout << "time for mergeFrom: " << merge_ms.count() << "ms\n";
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Prints the per-layer QueryStats of ranges of rangeSize keys on uniform
+/// keys, with the false positives attributed to their layers.
+void runQueryStatsExperiments(size_t numKeys, uint64_t rangeSize) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: per-layer query stats, " << numKeys
+            << " keys, 16 bits per key, ranges of " << rangeSize << " keys"
+            << std::endl;
+
+  std::mt19937_64 rng(3);
+  std::vector<uint64_t> keys(numKeys);
+  std::generate(keys.begin(), keys.end(), std::ref(rng));
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      numKeys * 2, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  bf.addBatch(keys);
+  std::sort(keys.begin(), keys.end());
+
+  filters::QueryStats stats;
+  for (size_t i = 0; i < 1000000; ++i) {
+    uint64_t low = rng() % (std::numeric_limits<uint64_t>::max() - rangeSize);
+    uint64_t high = low + (rangeSize - 1);
+    if (bf.findRange(low, high, stats)) {
+      auto lb = std::lower_bound(keys.begin(), keys.end(), low);
+      if (lb == keys.end() || *lb > high) {
+        stats.recordFalsePositive();
+      }
+    }
+  }
+
+  std::cout << std::setw(6) << "layer";
+  for (const char* column : {"partial", "covered", "words", "positives",
+                             "negatives", "false pos."}) {
+    std::cout << std::setw(12) << column;
+  }
+  std::cout << "\n";
+  for (size_t i = stats.layers.size(); i-- > 0;) {
+    const auto& layer = stats.layers[i];
+    std::cout << std::setw(6) << i;
+    for (uint64_t value : {layer.partialChecks, layer.coveredChecks,
+                           layer.words, layer.positives, layer.negatives,
+                           layer.falsePositives}) {
+      std::cout << std::setw(12) << value;
+    }
+    std::cout << "\n";
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Fills a filter of filterBytes in steps and prints the estimates of
+/// estimateFill next to the measured false positive rates, and how long
+/// the popcount takes.
+void runFillEstimateExperiments(size_t filterBytes, uint64_t rangeSize) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: fill estimates of a " << filterBytes
+            << " byte filter, ranges of " << rangeSize << " keys"
+            << std::endl;
+
+  std::mt19937_64 rng(4);
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      filterBytes, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  std::vector<uint64_t> keys;
+
+  for (const char* column : {"keys", "fill", "est. keys", "est. point",
+                             "point", "est. range", "range", "ms"}) {
+    std::cout << std::setw(12) << column;
+  }
+  std::cout << "\n";
+  for (size_t bitsPerKey : {64, 32, 16, 12, 8, 4}) {
+    size_t numKeys = filterBytes * 8 / bitsPerKey;
+    while (keys.size() < numKeys) {
+      keys.push_back(rng());
+      bf.add(keys.back());
+    }
+    std::vector<uint64_t> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto t1 = high_resolution_clock::now();
+    auto fill = bf.estimateFill();
+    auto t2 = high_resolution_clock::now();
+    double estimatedRange = bf.estimateRangeFpr(rangeSize, fill);
+
+    size_t points = 0, ranges = 0, emptyRanges = 0;
+    constexpr size_t QUERIES = 1000000;
+    for (size_t i = 0; i < QUERIES; ++i) {
+      points += bf.find(rng());
+      uint64_t low = rng() % (std::numeric_limits<uint64_t>::max() - rangeSize);
+      uint64_t high = low + (rangeSize - 1);
+      auto lb = std::lower_bound(sorted.begin(), sorted.end(), low);
+      if (lb == sorted.end() || *lb > high) {
+        ++emptyRanges;
+        ranges += bf.findRange(low, high);
+      }
+    }
+
+    std::cout << std::setw(12) << keys.size() << std::setw(12) << fill.fill
+              << std::setw(12) << static_cast<size_t>(fill.keys)
+              << std::setw(12) << fill.pointFpr << std::setw(12)
+              << static_cast<double>(points) / QUERIES << std::setw(12)
+              << estimatedRange << std::setw(12)
+              << static_cast<double>(ranges) / emptyRanges << std::setw(12)
+              << duration<double, std::milli>(t2 - t1).count() << "\n";
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Compares probing numShards independent filters, as a lookup over the
+/// SSTables of an LSM tree does, with one probe of a shard set holding the
+/// same keys.
+void runShardSetExperiments(size_t numShards, uint64_t rangeSize) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: " << numShards
+            << " shards of 20000 keys, ranges of " << rangeSize << " keys"
+            << std::endl;
+
+  BloomFilterRFParameters params{40000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  std::mt19937_64 rng(5);
+  std::vector<BloomRF<uint64_t>> filters;
+  filters::BloomRFShardSet<uint64_t> set{params, numShards};
+  for (size_t s = 0; s < numShards; ++s) {
+    std::vector<uint64_t> keys(20000);
+    std::generate(keys.begin(), keys.end(), std::ref(rng));
+    filters.emplace_back(params);
+    filters.back().addBatch(keys);
+    set.addBatch(s, keys);
+  }
+
+  constexpr size_t QUERIES = 20000;
+  std::vector<uint64_t> lows(QUERIES);
+  std::generate(lows.begin(), lows.end(), [&]() {
+    return rng() % (std::numeric_limits<uint64_t>::max() - rangeSize);
+  });
+
+  size_t separateFound = 0, setFound = 0;
+  auto t1 = high_resolution_clock::now();
+  for (auto low : lows) {
+    for (const auto& filter : filters) {
+      separateFound += filter.findRange(low, low + (rangeSize - 1));
+    }
+  }
+  auto t2 = high_resolution_clock::now();
+  for (auto low : lows) {
+    for (auto word : set.findRange(low, low + (rangeSize - 1))) {
+      setFound += std::popcount(word);
+    }
+  }
+  auto t3 = high_resolution_clock::now();
+
+  std::cout << "Separate filters: "
+            << duration<double, std::milli>(t2 - t1).count() << "ms, "
+            << separateFound << " shards found" << std::endl;
+  std::cout << "Shard set: " << duration<double, std::milli>(t3 - t2).count()
+            << "ms, " << setFound << " shards found" << std::endl;
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Counts the dTLB read misses of this thread in user space, if the kernel
+/// and the CPU expose the counter.
+class TlbMissCounter {
+ public:
+#if defined(__linux__)
+  TlbMissCounter() {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~TlbMissCounter() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  bool available() const { return fd >= 0; }
+
+  void start() {
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (::read(fd, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+    return count;
+  }
+#else
+  bool available() const { return false; }
+  void start() {}
+  uint64_t stop() { return 0; }
+#endif
+
+ private:
+  int fd = -1;
+};
+
+/// AnonHugePages of the process in kB, i.e. its transparent huge pages.
+size_t anonHugePagesKb() {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string field;
+  size_t kb = 0;
+  while (smaps >> field) {
+    if (field == "AnonHugePages:") {
+      smaps >> kb;
+      break;
+    }
+  }
+  return kb;
+}
+
+/// The online NUMA nodes, e.g. "0-1" in /sys/devices/system/node/online.
+std::vector<int> onlineNumaNodes() {
+  std::ifstream online("/sys/devices/system/node/online");
+  std::vector<int> nodes;
+  int first, last;
+  char dash;
+  while (online >> first) {
+    last = first;
+    if (online.peek() == '-') {
+      online >> dash >> last;
+    }
+    for (int node = first; node <= last; ++node) {
+      nodes.push_back(node);
+    }
+    if (online.peek() == ',') {
+      online.get();
+    }
+  }
+  return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+/// Probes a filter of filterBytes allocated with each memory policy and
+/// prints the dTLB misses and the time per lookup.  Run with the argument
+/// "tlb".  Huge TLB pages need a reserved pool, e.g.
+/// echo 600 > /proc/sys/vm/nr_hugepages for a 1 GiB filter.
+void runMemoryPolicyExperiments(size_t filterBytes) {
+  using filters::MemoryPolicy;
+  using filters::NumaPlacement;
+  using filters::Pages;
+
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: memory policies of a " << filterBytes
+            << " byte filter" << std::endl;
+  TlbMissCounter counter;
+  if (!counter.available()) {
+    std::cout << "dTLB miss counter unavailable, see "
+                 "/proc/sys/kernel/perf_event_paranoid"
+              << std::endl;
+  }
+
+  std::vector<int> nodes = onlineNumaNodes();
+  std::vector<std::pair<std::string, MemoryPolicy>> policies{
+      {"default", {}},
+      {"transparent", {Pages::Transparent}},
+      {"hugetlb", {Pages::HugeTLB}},
+      {"interleave", {Pages::Default, NumaPlacement::Interleave, nodes}},
+      {"transparent+interleave",
+       {Pages::Transparent, NumaPlacement::Interleave, nodes}}};
+
+  for (const char* column : {"policy", "huge kB", "find miss/op",
+                             "find ns/op", "range miss/op", "range ns/op"}) {
+    std::cout << std::setw(column == std::string_view{"policy"} ? 24 : 14)
+              << column;
+  }
+  std::cout << "\n";
+  constexpr size_t QUERIES = 2000000;
+  for (const auto& [name, policy] : policies) {
+    BloomFilterRFParameters params{filterBytes, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+    params.memory = policy;
+    std::unique_ptr<BloomRF<uint64_t>> bf;
+    try {
+      bf = std::make_unique<BloomRF<uint64_t>>(params);
+    } catch (const std::system_error& e) {
+      std::cout << std::setw(24) << name << "  skipped: " << e.what()
+                << std::endl;
+      continue;
+    } catch (const std::logic_error& e) {
+      // Policies other than the default need Linux.
+      std::cout << std::setw(24) << name << "  skipped: " << e.what()
+                << std::endl;
+      continue;
+    }
+    std::mt19937_64 rng(6);
+    for (size_t i = 0; i < filterBytes / 64; ++i) {
+      bf->add(rng());
+    }
+    size_t hugeKb = anonHugePagesKb();
+
+    size_t found = 0;
+    counter.start();
+    auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < QUERIES; ++i) {
+      found += bf->find(rng());
+    }
+    auto t2 = high_resolution_clock::now();
+    uint64_t findMisses = counter.stop();
+
+    counter.start();
+    auto t3 = high_resolution_clock::now();
+    for (size_t i = 0; i < QUERIES; ++i) {
+      uint64_t low = rng() >> 1;
+      found += bf->findRange(low, low + 1000000);
+    }
+    auto t4 = high_resolution_clock::now();
+    uint64_t rangeMisses = counter.stop();
+
+    auto perOp = [&](double value) { return value / QUERIES; };
+    auto misses = [&](uint64_t count) {
+      return counter.available() ? std::to_string(perOp(count)) : "n/a";
+    };
+    std::cout << std::setw(24) << name << std::setw(14) << hugeKb
+              << std::setw(14) << misses(findMisses) << std::setw(14)
+              << perOp(duration<double, std::nano>(t2 - t1).count())
+              << std::setw(14) << misses(rangeMisses) << std::setw(14)
+              << perOp(duration<double, std::nano>(t4 - t3).count())
+              << "  (" << found << " found)" << std::endl;
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Compares a filter whose layers share its memory with one whose layers
+/// have the sub-arrays sized by the advisor, on uniform keys and ranges of
+/// rangeSize keys.
+void runLayerSizesExperiments(size_t numKeys, uint64_t rangeSize) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: per-layer sub-arrays, " << numKeys
+            << " keys, 16 bits per key, ranges of " << rangeSize << " keys"
+            << std::endl;
+
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> keys(numKeys);
+  std::generate(keys.begin(), keys.end(), std::ref(rng));
+  std::vector<std::pair<uint64_t, uint64_t>> queries(1000000);
+  for (auto& [low, high] : queries) {
+    low = rng() % (std::numeric_limits<uint64_t>::max() - rangeSize);
+    high = low + (rangeSize - 1);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  auto advisor = filters::BloomRFAdvisor::forKey<uint64_t>(numKeys, 16);
+  advisor.addQueries(rangeSize);
+  auto advice = advisor.advise();
+  BloomFilterRFParameters partitioned = advice.params;
+  partitioned.layer_sizes = advisor.layerSizes(advice.params.delta);
+
+  for (const auto& params : {advice.params, partitioned}) {
+    BloomRF<uint64_t> bf{params};
+    bf.addBatch(keys);
+
+    std::vector<bool> results;
+    results.reserve(queries.size());
+    auto t1 = high_resolution_clock::now();
+    for (const auto& [low, high] : queries) {
+      results.push_back(bf.findRange(low, high));
+    }
+    auto t2 = high_resolution_clock::now();
+
+    size_t fp = 0, negatives = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+      auto lb =
+          std::lower_bound(keys.begin(), keys.end(), queries[i].first);
+      if (lb == keys.end() || *lb > queries[i].second) {
+        ++negatives;
+        fp += results[i];
+      }
+    }
+
+    duration<double, std::milli> range_ms = t2 - t1;
+    std::cout << (params.layer_sizes.empty() ? "shared" : "sub-arrays")
+              << ": predicted fpr: "
+              << advisor.predictFpr(params.delta, rangeSize,
+                                    params.layer_sizes)
+              << ", fpr: " << static_cast<double>(fp) / negatives
+              << ", time for 1000000 range queries: "
+              << range_ms.count() << "ms\n";
+  }
+  std::cout << "------------------------" << std::endl;
+}
+
+/// Compares StaticBloomRF with BloomRF of the same delta vector on uniform
+/// keys, point queries and ranges of 1e8 keys.
+void runStaticExperiments(size_t numKeys) {
+  std::cout << "------------------------" << std::endl;
+  std::cout << "Running experiment: static and dynamic delta vector, "
+            << numKeys << " keys, 16 bits per key" << std::endl;
+
+  std::mt19937_64 rng(7);
+  std::vector<uint64_t> keys(numKeys);
+  std::generate(keys.begin(), keys.end(), std::ref(rng));
+  std::vector<uint64_t> queries(1000000);
+  std::generate(queries.begin(), queries.end(), std::ref(rng));
+  size_t filterSize = numKeys * 2;
+
+  auto time = [&](const std::string& name, auto& bf) {
+    auto t1 = high_resolution_clock::now();
+    for (auto key : keys) {
+      bf.add(key);
+    }
+    auto t2 = high_resolution_clock::now();
+    size_t found = 0;
+    for (auto query : queries) {
+      found += bf.find(query);
+    }
+    auto t3 = high_resolution_clock::now();
+    size_t rangesFound = 0;
+    for (auto query : queries) {
+      uint64_t high = query + 100000000;
+      rangesFound += bf.findRange(
+          query, high < query ? std::numeric_limits<uint64_t>::max() : high);
+    }
+    auto t4 = high_resolution_clock::now();
+
+    duration<double, std::milli> insert_ms = t2 - t1;
+    duration<double, std::milli> point_ms = t3 - t2;
+    duration<double, std::milli> range_ms = t4 - t3;
+    std::cout << name << ": time for " << numKeys
+              << " adds: " << insert_ms.count()
+              << "ms, 1000000 point queries: " << point_ms.count() << "ms ("
+              << found << " found), 1000000 range queries of size 1e8: "
+              << range_ms.count() << "ms (" << rangesFound << " found)\n";
+  };
+
+  BloomRF<uint64_t> dynamic{
+      BloomFilterRFParameters{filterSize, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  time("dynamic", dynamic);
+  filters::StaticBloomRF<uint64_t, uint64_t, 7, 7, 7, 4, 4, 2, 2, 2> fixed{
+      filterSize, 0};
+  time("static", fixed);
+  std::cout << "------------------------" << std::endl;
+}
+
 }  // namespace
 
 namespace {
@@ -96,7 +891,8 @@ double genNormalDouble(double mean, double stddev) {
 
 }  // namespace
 
-int main() {
+/// The experiments of the original paper reproduction, which CI runs.
+void runBaselineExperiments() {
   runPointExperiments<uint64_t>(
       []() { return genNormalUInt(1ULL << 33, 1ULL << 31); },
       []() { return genNormalUInt(1ULL << 33, 1ULL << 31); },
@@ -138,3 +934,106 @@ int main() {
       []() { return genNormalDouble(1ULL << 32, 1ULL << 31); },
       "floats, normal distribution");
 }
+
+/// Runs the baseline experiments without arguments.  The other experiments
+/// are heavier and only run when named on the command line, or all of them
+/// but tlb with "all".
+int main(int argc, char** argv) {
+  auto uniform = []() {
+    return genUniformUInt(0, std::numeric_limits<uint64_t>::max());
+  };
+  std::vector<std::pair<std::string_view, std::function<void()>>> selectable{
+      {"bitrange", []() { runBitRangeExperiments(); }},
+      {"static",
+       []() {
+         for (size_t numKeys : {2000000, 16000000}) {
+           runStaticExperiments(numKeys);
+         }
+       }},
+      {"parallel", []() { runParallelBuildExperiments(16000000); }},
+      {"merge", []() { runMergeExperiments(8000000); }},
+      {"layersizes",
+       []() {
+         for (uint64_t rangeSize : {1, 1000, 1000000}) {
+           runLayerSizesExperiments(2000000, rangeSize);
+         }
+       }},
+      {"stats",
+       []() {
+         for (uint64_t rangeSize : {1000, 1000000}) {
+           runQueryStatsExperiments(2000000, rangeSize);
+         }
+       }},
+      {"fill",
+       []() {
+         for (uint64_t rangeSize : {1000, 1000000}) {
+           runFillEstimateExperiments(4000000, rangeSize);
+         }
+       }},
+      {"shards",
+       []() {
+         for (size_t numShards : {16, 256}) {
+           runShardSetExperiments(numShards, 1000);
+         }
+       }},
+      {"batch",
+       [&]() {
+         runBatchExperiments<uint64_t>(
+             uniform,
+             "batch add, find and findRange, unsigned integer, uniform "
+             "distribution");
+       }},
+      {"hash",
+       [&]() {
+         runHashExperiments<filters::CityHashPolicy>(
+             uniform, uniform, "hash policy: 2x CityHash64 per layer");
+         runHashExperiments<filters::City128HashPolicy>(
+             uniform, uniform, "hash policy: 1x CityHash128 per layer");
+         runHashExperiments<filters::MixHashPolicy>(
+             uniform, uniform, "hash policy: multiply-xorshift per layer");
+         runHashExperiments<filters::MixHashPolicy>(
+             uniform, uniform,
+             "index reduction: multiply-shift, multiply-xorshift per layer",
+             filters::IndexReduction::MultiplyShift);
+         runHashExperiments<filters::MixHashPolicy>(
+             uniform, uniform,
+             "index reduction: power of two, multiply-xorshift per layer",
+             filters::IndexReduction::PowerOfTwo);
+       }},
+      {"layout",
+       [&]() {
+         for (size_t numKeys : {2000000, 16000000}) {
+           std::string keys =
+               std::to_string(numKeys) + " keys, 16 bits per key";
+           runLayoutExperiments(numKeys, 16, filters::Layout::Flat, uniform,
+                                "flat layout, " + keys);
+           runLayoutExperiments(numKeys, 16, filters::Layout::Blocked, uniform,
+                                "blocked layout, " + keys);
+         }
+       }},
+      {"tlb", []() { runMemoryPolicyExperiments(size_t{1} << 30); }}};
+
+  if (argc == 1) {
+    runBaselineExperiments();
+    return 0;
+  }
+  for (int i = 1; i < argc; ++i) {
+    std::string_view name{argv[i]};
+    bool known = name == "all";
+    for (const auto& [experiment, run] : selectable) {
+      if (experiment == name || (name == "all" && experiment != "tlb")) {
+        run();
+        known = true;
+      }
+    }
+    if (!known) {
+      std::cerr << "Unknown experiment " << name << ", expected one of all";
+      for (const auto& [experiment, run] : selectable) {
+        std::cerr << ", " << experiment;
+      }
+      std::cerr << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -19,7 +19,7 @@
 using filters::BloomFilterRFParameters;
 using filters::BloomRF;
 
-template <typename T>
+template <typename T, typename HashPolicy = filters::CityHashPolicy>
 class ExperimentDriver {
 
  public:
@@ -120,7 +120,7 @@ class ExperimentDriver {
 
   std::random_device rd;
   std::mt19937 gen;
-  BloomRF<T> bf;
+  BloomRF<T, uint64_t, HashPolicy> bf;
   std::vector<T> s;
   std::function<T()> keyGenerator;
   std::function<T()> queryKeyGenerator;
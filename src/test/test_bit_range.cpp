@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bloomRF/bitRange.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+using detail::SimdLevel;
+
+std::vector<SimdLevel> supportedLevels() {
+  std::vector<SimdLevel> levels{SimdLevel::Scalar};
+  if (detail::supportedSimdLevel() >= SimdLevel::Avx2) {
+    levels.push_back(SimdLevel::Avx2);
+  }
+  if (detail::supportedSimdLevel() >= SimdLevel::Avx512) {
+    levels.push_back(SimdLevel::Avx512);
+  }
+  return levels;
+}
+
+bool anyBitInRangeReference(const std::vector<uint64_t>& words,
+                            size_t lowBit,
+                            size_t highBit) {
+  for (size_t bit = lowBit; bit <= highBit; ++bit) {
+    if ((words[bit / 64] >> (bit % 64)) & 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST(BitRange, KernelsMatchReference) {
+  std::mt19937_64 gen(3);
+  for (size_t words : {1, 2, 5, 8, 13, 32}) {
+    for (size_t round = 0; round < 200; ++round) {
+      // Sparse words, so that many ranges contain no set bit.
+      std::vector<uint64_t> filter(words);
+      for (auto& word : filter) {
+        word = gen() & gen() & gen() & gen() & gen();
+      }
+      size_t lowBit = gen() % (64 * words);
+      size_t highBit = lowBit + gen() % (64 * words - lowBit);
+      bool expected = anyBitInRangeReference(filter, lowBit, highBit);
+      for (auto level : supportedLevels()) {
+        ASSERT_EQ(detail::anyBitInRange(filter.data(), lowBit, highBit, level),
+                  expected)
+            << "level " << static_cast<int>(level) << ", words " << words
+            << ", bits [" << lowBit << ", " << highBit << "]";
+      }
+      ASSERT_EQ(detail::anyBitInRange(filter.data(), lowBit, highBit),
+                expected);
+    }
+  }
+}
+
+TEST(BitRange, SingleBits) {
+  std::vector<uint64_t> filter(9);
+  for (size_t bit = 0; bit < 64 * filter.size(); ++bit) {
+    std::fill(filter.begin(), filter.end(), 0);
+    filter[bit / 64] = uint64_t{1} << (bit % 64);
+    for (auto level : supportedLevels()) {
+      ASSERT_TRUE(detail::anyBitInRange(filter.data(), 0, 64 * 9 - 1, level));
+      ASSERT_TRUE(detail::anyBitInRange(filter.data(), bit, bit, level));
+      if (bit > 0) {
+        ASSERT_FALSE(detail::anyBitInRange(filter.data(), 0, bit - 1, level));
+      }
+      if (bit < 64 * 9 - 1) {
+        ASSERT_FALSE(
+            detail::anyBitInRange(filter.data(), bit + 1, 64 * 9 - 1, level));
+      }
+    }
+  }
+}
+
+TEST(BitRange, CombineWordsKernelsMatchReference) {
+  std::mt19937_64 gen(7);
+  for (size_t bytes : {0, 1, 7, 8, 31, 32, 63, 64, 100, 1000}) {
+    std::vector<unsigned char> a(bytes), b(bytes);
+    for (size_t i = 0; i < bytes; ++i) {
+      a[i] = gen();
+      b[i] = gen();
+    }
+    for (auto op : {detail::WordOp::Or, detail::WordOp::And}) {
+      std::vector<unsigned char> expected(bytes);
+      for (size_t i = 0; i < bytes; ++i) {
+        expected[i] = op == detail::WordOp::Or ? a[i] | b[i] : a[i] & b[i];
+      }
+      for (auto level : supportedLevels()) {
+        std::vector<unsigned char> dst = a;
+        detail::combineWords(dst.data(), b.data(), bytes, op, level);
+        ASSERT_EQ(dst, expected) << "level " << static_cast<int>(level)
+                                 << ", bytes " << bytes;
+      }
+    }
+  }
+}
+
+TEST(BitRange, CountBitsKernelsMatchReference) {
+  std::mt19937_64 gen(8);
+  for (size_t bytes : {0, 1, 7, 8, 31, 32, 63, 64, 100, 1000, 4096}) {
+    std::vector<unsigned char> words(bytes);
+    size_t expected = 0;
+    for (auto& byte : words) {
+      byte = gen();
+      expected += std::popcount(byte);
+    }
+    for (auto level : supportedLevels()) {
+      ASSERT_EQ(detail::countBits(words.data(), bytes, level), expected)
+          << "level " << static_cast<int>(level) << ", bytes " << bytes;
+    }
+  }
+}
+
+TEST(BitRange, WidePmhfWordsNoFalseNegatives) {
+  // Layers with 2048 and 512 bit PMHF words go through the SIMD kernels.
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{64000, 0, {12, 10, 8, 4}}};
+  std::mt19937_64 gen(5);
+  std::vector<uint64_t> keys(2000);
+  for (auto& key : keys) {
+    key = gen();
+  }
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    uint64_t low = key - gen() % 100000;
+    uint64_t high = key + gen() % 100000;
+    ASSERT_TRUE(bf.findRange(low, high));
+    ASSERT_TRUE(bf.findRange(key, key));
+  }
+}
+
+}  // namespace test
+}  // namespace filters
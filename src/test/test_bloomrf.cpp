@@ -198,6 +198,378 @@ TEST(OneOff, RangeQuery) {
   ASSERT_TRUE(bf.findRange(key - 9, key + 8));
 }
 
+TEST(Batch, AddBatchMatchesAdd) {
+  BloomFilterRFParameters params{16000, 0, {9, 8, 6, 4, 3, 2}};
+  BloomRF<uint64_t, uint64_t> bf{params};
+  BloomRF<uint64_t, uint64_t> batched{params};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  // Sorted runs of nearby keys exercise the shared prefix path.
+  for (uint64_t i = 0; i < 500; ++i) {
+    keys.push_back(keys[0] + i);
+  }
+
+  for (auto key : keys) {
+    bf.add(key);
+  }
+  batched.addBatch(keys);
+
+  size_t words = (params.filter_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  for (size_t i = 0; i < words; ++i) {
+    ASSERT_EQ(bf.getFilter()[i], batched.getFilter()[i]);
+  }
+  for (auto key : keys) {
+    ASSERT_TRUE(batched.find(key));
+  }
+}
+
+TEST(Batch, AddBatchMatchesAddSmallUnderType) {
+  BloomFilterRFParameters params{16000, 0, {12, 9, 7, 4}};
+  BloomRF<uint64_t, uint32_t> bf{params};
+  BloomRF<uint64_t, uint32_t> batched{params};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+
+  for (auto key : keys) {
+    bf.add(key);
+  }
+  batched.addBatch(keys);
+
+  size_t words = (params.filter_size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+  for (size_t i = 0; i < words; ++i) {
+    ASSERT_EQ(bf.getFilter()[i], batched.getFilter()[i]);
+  }
+}
+
+TEST(Batch, FindBatchMatchesFind) {
+  BloomRF<uint64_t, uint64_t> bf{
+      BloomFilterRFParameters{4000, 0, {9, 8, 6, 4, 3, 2}}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  bf.addBatch(keys);
+
+  // Half inserted keys, half (most likely) absent keys.
+  std::vector<uint64_t> queries(keys.begin(), keys.begin() + 500);
+  std::generate_n(std::back_inserter(queries), 500, randomUniformUint64);
+
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  bf.findBatch(queries, out.get());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    ASSERT_EQ(bf.find(queries[i]), out[i]);
+  }
+  for (size_t i = 0; i < 500; ++i) {
+    ASSERT_TRUE(out[i]);
+  }
+}
+
+TEST(Batch, FindRangeBatchMatchesFindRange) {
+  BloomRF<uint64_t, uint64_t> bf{
+      BloomFilterRFParameters{8000, 0, {9, 8, 7, 6, 4, 3, 2}}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  bf.addBatch(keys);
+
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (size_t i = 0; i < 500; ++i) {
+    ranges.emplace_back(keys[i] - rand() % 1000, keys[i] + rand() % 1000);
+  }
+  // Clusters of overlapping ranges share their upper layer probes.
+  for (size_t i = 0; i < 500; ++i) {
+    uint64_t low = keys[i % 10] + rand() % 100000;
+    ranges.emplace_back(low, low + rand() % 100000);
+  }
+  for (size_t i = 0; i < 500; ++i) {
+    uint64_t low = randomUniformUint64();
+    ranges.emplace_back(low, low + (low >> 40));
+  }
+  ranges.emplace_back(keys[0], keys[0]);
+
+  std::unique_ptr<bool[]> out(new bool[ranges.size()]);
+  bf.findRangeBatch(ranges, out.get());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    ASSERT_EQ(bf.findRange(ranges[i].first, ranges[i].second), out[i])
+        << "[" << ranges[i].first << "," << ranges[i].second << "]";
+  }
+  for (size_t i = 0; i < 500; ++i) {
+    ASSERT_TRUE(out[i]);
+  }
+}
+
+template <typename HashPolicy>
+class HashPolicyTest : public ::testing::Test {};
+
+using HashPolicies =
+    ::testing::Types<CityHashPolicy, City128HashPolicy, MixHashPolicy>;
+TYPED_TEST_SUITE(HashPolicyTest, HashPolicies);
+
+TYPED_TEST(HashPolicyTest, NoFalseNegatives) {
+  BloomRF<uint64_t, uint64_t, TypeParam> bf{
+      BloomFilterRFParameters{16000, 0, {9, 8, 6, 4, 3, 2}}};
+  BloomRF<int32_t, uint64_t, TypeParam> sbf{
+      BloomFilterRFParameters{16000, 0, {6, 5, 4, 3}}};
+  // Every policy also supports 32-bit words.
+  BloomRF<uint64_t, uint32_t, TypeParam> narrow{
+      BloomFilterRFParameters{16000, 0, {6, 6, 6, 4, 3, 2}}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  for (auto key : keys) {
+    bf.add(key);
+    sbf.add(static_cast<int32_t>(key));
+    narrow.add(key);
+  }
+
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(bf.findRange(key - rand() % 1000, key + rand() % 1000));
+    ASSERT_TRUE(sbf.find(static_cast<int32_t>(key)));
+    ASSERT_TRUE(narrow.find(key));
+    ASSERT_TRUE(narrow.findRange(key - rand() % 1000, key + rand() % 1000));
+  }
+}
+
+TEST(Layout, BlockedNoFalseNegatives) {
+  BloomRF<uint64_t, uint64_t> bf{BloomFilterRFParameters{
+      16000, 0, {9, 8, 6, 4, 3, 2}, Layout::Blocked}};
+  BloomRF<uint64_t, uint32_t> small{BloomFilterRFParameters{
+      16000, 0, {10, 7, 5, 3}, Layout::Blocked}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    small.add(key);
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(small.find(key));
+    uint64_t low = key - rand() % 1000;
+    uint64_t high = key + rand() % 1000;
+    ASSERT_TRUE(bf.findRange(low, high));
+    ASSERT_TRUE(small.findRange(low, high));
+    ranges.emplace_back(low, high);
+  }
+
+  std::unique_ptr<bool[]> out(new bool[keys.size()]);
+  bf.findBatch(keys, out.get());
+  ASSERT_TRUE(std::all_of(out.get(), out.get() + keys.size(),
+                          [](bool found) { return found; }));
+  bf.findRangeBatch(ranges, out.get());
+  ASSERT_TRUE(std::all_of(out.get(), out.get() + keys.size(),
+                          [](bool found) { return found; }));
+}
+
+/// Returns the cache lines with bits set in the words of bf.
+template <typename Filter>
+std::unordered_set<size_t> touchedLines(const Filter& bf, size_t filterSize) {
+  std::unordered_set<size_t> lines;
+  for (size_t i = 0; i < filterSize / sizeof(uint64_t); ++i) {
+    if (bf.getFilter()[i] != 0) {
+      lines.insert(i * sizeof(uint64_t) / 64);
+    }
+  }
+  return lines;
+}
+
+TEST(Layout, BlockedLayersShareOneCacheLine) {
+  BloomFilterRFParameters params{64000, 0, {9, 8, 6, 4, 3, 2},
+                                 Layout::Blocked};
+  for (size_t n = 0; n < 100; ++n) {
+    BloomRF<uint64_t, uint64_t> bf{params};
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(bf.getFilter().get()) % 64, 0);
+    bf.add(randomUniformUint64());
+    ASSERT_EQ(touchedLines(bf, params.filter_size).size(), 1);
+  }
+}
+
+TEST(Layout, DefaultBlockedLayers) {
+  // 2^14 blocks.  Layer i hashes a prefix of 64 - (shifts[i] + delta[i] - 1)
+  // bits, that is 57, 49, 41, 33, 25, 17 and 9 bits, so only the lower five
+  // layers have at least 64 times as many prefixes as there are blocks.
+  BloomFilterRFParameters params{1 << 20, 0, {8, 8, 8, 8, 8, 8, 8},
+                                 Layout::Blocked};
+  for (size_t n = 0; n < 20; ++n) {
+    BloomRF<uint64_t, uint64_t> bf{params};
+    bf.add(randomUniformUint64());
+    ASSERT_LE(touchedLines(bf, params.filter_size).size(), 3);
+  }
+
+  // A PMHF word of the lowest layer that is wider than a block leaves no
+  // layer to block.
+  params.delta = {11, 8};
+  EXPECT_THROW((BloomRF<uint64_t, uint64_t>(params)), std::logic_error);
+}
+
+TEST(Layout, PartiallyBlockedClusteredKeys) {
+  // The keys differ in their low 24 bits only, which leaves the upper layers
+  // with few distinct prefixes, so only the three lowest layers are blocked.
+  BloomRF<uint64_t, uint64_t> bf{BloomFilterRFParameters{
+      16000, 0, {7, 7, 7, 4, 4, 2, 2, 2}, Layout::Blocked, 3}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), []() {
+    return (1ULL << 33) + randomUniformUint64() % (1 << 24);
+  });
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(bf.findRange(key - rand() % 100000, key + rand() % 100000));
+  }
+}
+
+TEST(Layout, RejectsInvalidBlockedLayouts) {
+  using Filter = BloomRF<uint64_t, uint64_t>;
+  // More blocked layers than layers.
+  EXPECT_THROW(Filter(BloomFilterRFParameters{4000, 0, {4, 3}, Layout::Blocked,
+                                              3}),
+               std::logic_error);
+  // A PMHF word of 1024 bits does not fit into a block.
+  EXPECT_THROW(
+      Filter(BloomFilterRFParameters{4000, 0, {11, 3}, Layout::Blocked, 1}),
+      std::logic_error);
+  // Unless that layer is left out of the block.
+  EXPECT_NO_THROW(
+      Filter(BloomFilterRFParameters{4000, 0, {3, 11}, Layout::Blocked, 1}));
+  // 2^3 prefixes of the top layer cannot spread keys over 64 blocks.
+  EXPECT_THROW((BloomRF<uint16_t, uint64_t>(BloomFilterRFParameters{
+                   4096, 0, {7, 7}, Layout::Blocked, 2})),
+               std::logic_error);
+  // Nor can the 2^10 prefixes of the lowest layer by default.
+  EXPECT_THROW((BloomRF<uint16_t, uint64_t>(BloomFilterRFParameters{
+                   4096, 0, {7, 7}, Layout::Blocked})),
+               std::logic_error);
+}
+
+TEST(Layout, LayerSizesNoFalseNegatives) {
+  // The top layer has PMHF words of 1024 bits, wider than UnderType.
+  BloomRF<uint64_t, uint64_t> bf{BloomFilterRFParameters{
+      16000, 0, {7, 7, 5, 4, 11}, Layout::Flat, 0, {6000, 6000, 3000, 512, 488}}};
+  BloomRF<uint64_t, uint32_t> small{BloomFilterRFParameters{
+      16000, 0, {6, 5, 4}, Layout::Flat, 0, {8000, 7000, 1000}}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformUint64);
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    small.add(key);
+  }
+
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(small.find(key));
+    uint64_t low = key - rand() % 100000;
+    uint64_t high = key + rand() % 100000;
+    ASSERT_TRUE(bf.findRange(low, high));
+    ASSERT_TRUE(small.findRange(low, high));
+  }
+}
+
+TEST(Layout, LayersStayInTheirSubArrays) {
+  // Every layer gets whole cache lines, so a key touches one line in each of
+  // the three sub-arrays.
+  BloomFilterRFParameters params{1024, 0, {6, 6, 6}, Layout::Flat, 0,
+                                 {512, 384, 128}};
+  for (size_t n = 0; n < 100; ++n) {
+    BloomRF<uint64_t, uint64_t> bf{params};
+    bf.add(randomUniformUint64());
+    auto lines = touchedLines(bf, params.filter_size);
+    ASSERT_EQ(lines.size(), 3);
+    ASSERT_EQ(std::count_if(lines.begin(), lines.end(),
+                            [](size_t line) { return line < 8; }),
+              1);
+    ASSERT_EQ(std::count_if(lines.begin(), lines.end(),
+                            [](size_t line) { return line >= 14; }),
+              1);
+  }
+}
+
+TEST(Layout, RejectsInvalidLayerSizes) {
+  using Filter = BloomRF<uint64_t, uint64_t>;
+  // One size per layer.
+  EXPECT_THROW(Filter(BloomFilterRFParameters{4000, 0, {4, 3}, Layout::Flat, 0,
+                                              {4000}}),
+               std::logic_error);
+  // Sizes add up to the filter size.
+  EXPECT_THROW(Filter(BloomFilterRFParameters{4000, 0, {4, 3}, Layout::Flat, 0,
+                                              {3000, 2000}}),
+               std::logic_error);
+  EXPECT_THROW(Filter(BloomFilterRFParameters{4000, 0, {4, 3}, Layout::Flat, 0,
+                                              {4000, 0}}),
+               std::logic_error);
+  EXPECT_THROW(Filter(BloomFilterRFParameters{
+                   4096, 0, {4, 3}, Layout::Blocked, 0, {2048, 2048}}),
+               std::logic_error);
+  // Every layer holds a PMHF word of every layer, which would otherwise
+  // inflate it.
+  EXPECT_THROW(Filter(BloomFilterRFParameters{128, 0, {11, 3}, Layout::Flat, 0,
+                                              {64, 64}}),
+               std::logic_error);
+  EXPECT_THROW(Filter(BloomFilterRFParameters{128, 0, {40, 4}, Layout::Flat, 0,
+                                              {64, 64}}),
+               std::logic_error);
+}
+
+TEST(IndexReduction, NoFalseNegatives) {
+  for (auto reduction : {IndexReduction::Modulo, IndexReduction::MultiplyShift,
+                         IndexReduction::PowerOfTwo}) {
+    std::vector<BloomFilterRFParameters> params{
+        {16000, 0, {7, 7, 7, 4, 4, 2, 2, 2}},
+        {16000, 0, {9, 8, 6, 4, 3, 2}, Layout::Blocked},
+        {16000, 0, {7, 7, 5, 4, 11}, Layout::Flat, 0,
+         {6000, 6000, 3000, 512, 488}}};
+    for (auto& p : params) {
+      p.reduction = reduction;
+      BloomRF<uint64_t, uint64_t> bf{p};
+      std::vector<uint64_t> keys(1000);
+      std::generate(keys.begin(), keys.end(), randomUniformUint64);
+      bf.addBatch(keys);
+      for (auto key : keys) {
+        ASSERT_TRUE(bf.find(key));
+        ASSERT_TRUE(
+            bf.findRange(key - rand() % 100000, key + rand() % 100000));
+      }
+    }
+  }
+}
+
+TEST(IndexReduction, MultiplyShiftUsesWholeFilter) {
+  // 1000 words that are not a power of two.  Uniform keys reach the words
+  // at the end of the filter, too.
+  BloomFilterRFParameters params{8000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  params.reduction = IndexReduction::MultiplyShift;
+  BloomRF<uint64_t, uint64_t> bf{params};
+  for (size_t i = 0; i < 4000; ++i) {
+    bf.add(randomUniformUint64());
+  }
+  ASSERT_NE(bf.getFilter()[999], 0);
+  ASSERT_NE(bf.getFilter()[0], 0);
+}
+
+TEST(IndexReduction, RejectsPmhfWordsWiderThanTheFilter) {
+  // One word of 64 bits, which a layer with delta 8 cannot hash into.
+  for (auto reduction : {IndexReduction::Modulo, IndexReduction::MultiplyShift,
+                         IndexReduction::PowerOfTwo}) {
+    BloomFilterRFParameters params{8, 0, {8, 4}};
+    params.reduction = reduction;
+    EXPECT_THROW((BloomRF<uint64_t, uint64_t>(params)), std::logic_error);
+  }
+  EXPECT_THROW((BloomRF<unsigned __int128, uint64_t>(
+                   BloomFilterRFParameters{4000, 0, {100, 4}})),
+               std::logic_error);
+}
+
+TEST(IndexReduction, RejectsUnknownReduction) {
+  BloomFilterRFParameters params{4000, 0, {4, 3}};
+  params.reduction = static_cast<IndexReduction>(3);
+  EXPECT_THROW((BloomRF<uint64_t, uint64_t>(params)), std::logic_error);
+}
+
 TEST_P(BloomFilterUniform32Test, NoFalseNegativesPointQuery) {
   for (auto it = s.cbegin(); it != s.cend(); ++it) {
     ASSERT_TRUE(bf.find(*it));
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bloomRF/advisor.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+constexpr size_t KEYS = 100000;
+constexpr double BITS_PER_KEY = 16;
+
+/// Fraction of empty ranges of rangeSize keys that filter reports.
+double measureFpr(const BloomFilterRFParameters& params,
+                  uint64_t rangeSize,
+                  size_t queries) {
+  BloomRF<uint32_t> filter{params};
+  std::mt19937 gen(7);
+  std::vector<uint32_t> keys(KEYS);
+  for (auto& key : keys) {
+    key = gen();
+    filter.add(key);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  size_t empty = 0;
+  size_t positives = 0;
+  while (empty < queries) {
+    uint32_t low = gen();
+    uint32_t high = low + (rangeSize - 1);
+    if (high < low) {
+      continue;
+    }
+    auto it = std::lower_bound(keys.begin(), keys.end(), low);
+    if (it != keys.end() && *it <= high) {
+      continue;
+    }
+    ++empty;
+    positives += filter.findRange(low, high);
+  }
+  return static_cast<double>(positives) / empty;
+}
+
+}  // namespace
+
+TEST(Advisor, PredictionMatchesMeasurement) {
+  auto advisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  std::vector<size_t> delta{6, 6, 5, 4, 3, 2};
+  BloomFilterRFParameters params{KEYS * 2, 0, delta};
+  for (uint64_t rangeSize : {1, 16, 1000}) {
+    double predicted = advisor.predictFpr(delta, rangeSize);
+    double measured = measureFpr(params, rangeSize, 20000);
+    EXPECT_GT(predicted, measured / 2) << rangeSize;
+    EXPECT_LT(predicted, measured * 2) << rangeSize;
+  }
+}
+
+TEST(Advisor, AdviceIsValid) {
+  auto advisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  advisor.addQueries(1, 2);
+  advisor.addQueries(100);
+  auto advice = advisor.advise();
+
+  const auto& delta = advice.params.delta;
+  ASSERT_FALSE(delta.empty());
+  EXPECT_LE(std::accumulate(delta.begin(), delta.end(), size_t{0}), 32);
+  EXPECT_LE(delta.size(), BloomRFAdvisor::MAX_LAYERS);
+  EXPECT_EQ(advice.params.filter_size, KEYS * 2);
+  EXPECT_DOUBLE_EQ(advice.point_fpr, advisor.predictFpr(delta, 1));
+
+  // The advised parameters build a working filter.
+  BloomRF<uint32_t> filter{advice.params};
+  filter.add(4711);
+  EXPECT_TRUE(filter.find(4711));
+  EXPECT_TRUE(filter.findRange(4000, 5000));
+}
+
+TEST(Advisor, PointWorkloadBeatsDefaults) {
+  auto advisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  advisor.addQueries(1);
+  auto advice = advisor.advise();
+  EXPECT_LE(advice.point_fpr, advisor.predictFpr({7, 7, 7, 4, 4, 2}, 1));
+
+  double measured = measureFpr(advice.params, 1, 20000);
+  EXPECT_LT(measured, 2 * advice.point_fpr + 0.001);
+}
+
+TEST(Advisor, RangeWorkloadBeatsPointTuning) {
+  auto pointAdvisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  pointAdvisor.addQueries(1);
+  auto pointAdvice = pointAdvisor.advise();
+
+  auto rangeAdvisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  std::vector<uint64_t> sample(100, 5000);
+  rangeAdvisor.addQuerySample(sample);
+  auto rangeAdvice = rangeAdvisor.advise();
+
+  EXPECT_LT(rangeAdvice.range_fpr,
+            rangeAdvisor.predictFpr(pointAdvice.params.delta, 5000));
+  EXPECT_LT(measureFpr(rangeAdvice.params, 5000, 5000),
+            measureFpr(pointAdvice.params, 5000, 5000));
+}
+
+TEST(Advisor, LayerSizesLowerFpr) {
+  auto advisor = BloomRFAdvisor::forKey<uint32_t>(KEYS, BITS_PER_KEY);
+  advisor.addQueries(1000);
+  std::vector<size_t> delta{6, 6, 5, 4, 3, 2};
+  auto sizes = advisor.layerSizes(delta);
+  ASSERT_EQ(sizes.size(), delta.size());
+  ASSERT_EQ(std::accumulate(sizes.begin(), sizes.end(), size_t{0}), KEYS * 2);
+
+  BloomFilterRFParameters shared{KEYS * 2, 0, delta};
+  BloomFilterRFParameters partitioned{KEYS * 2, 0,     delta,
+                                      Layout::Flat, 0, sizes};
+  EXPECT_LT(advisor.predictFpr(delta, 1000, sizes),
+            advisor.predictFpr(delta, 1000));
+  EXPECT_LT(measureFpr(partitioned, 1000, 10000),
+            measureFpr(shared, 1000, 10000));
+}
+
+TEST(Advisor, InvalidInput) {
+  auto advisor = BloomRFAdvisor::forKey<uint64_t>(KEYS, BITS_PER_KEY);
+  EXPECT_THROW(advisor.advise(), std::logic_error);
+  EXPECT_THROW(advisor.addQueries(0), std::logic_error);
+  EXPECT_THROW(advisor.predictFpr({40, 30}, 1), std::logic_error);
+  EXPECT_THROW(BloomRFAdvisor(0, 16, 64), std::logic_error);
+  EXPECT_THROW(BloomRFAdvisor(KEYS, 16, 65), std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <system_error>
+#include "gtest/gtest.h"
+
+#include <limits>
+#include <random>
+
+#include "bloomRF/bloomRFShardSet.h"
+#include "test_helpers.h"
+
+namespace {
+
+// Counts the heap allocations made by this thread while counting is enabled.
+thread_local bool countAllocations = false;
+thread_local size_t allocations = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (countAllocations) {
+    ++allocations;
+  }
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace filters {
+namespace test {
+
+TEST(Allocation, FindRangeDoesNotAllocate) {
+  std::mt19937_64 gen(42);
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{16000, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  BloomRF<int32_t> sbf{BloomFilterRFParameters{16000, 0, {6, 5, 4, 3, 2}}};
+
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), gen);
+  for (auto key : keys) {
+    bf.add(key);
+    sbf.add(static_cast<int32_t>(key));
+  }
+
+  size_t found = 0;
+  countAllocations = true;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t low = keys[i] - i * 1000;
+    found += bf.findRange(low, low + i * 100000);
+    found += bf.findRange(gen(), std::numeric_limits<uint64_t>::max());
+    found += sbf.findRange(static_cast<int32_t>(keys[i]) - 1000,
+                           static_cast<int32_t>(keys[i]));
+  }
+  countAllocations = false;
+
+  ASSERT_EQ(allocations, 0);
+  ASSERT_GT(found, 0);
+}
+
+#if defined(__linux__)
+namespace {
+
+/// Checks that a filter allocated with policy finds what a default one with
+/// the same keys finds.
+void checkMemoryPolicy(const MemoryPolicy& policy) {
+  BloomFilterRFParameters params{1 << 22, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  BloomRF<uint64_t> reference{params};
+  params.memory = policy;
+  BloomRF<uint64_t> bf{params};
+
+  std::mt19937_64 gen(7);
+  std::vector<uint64_t> keys(10000);
+  std::generate(keys.begin(), keys.end(), gen);
+  reference.addBatch(keys);
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    uint64_t low = gen();
+    ASSERT_EQ(bf.findRange(low, low + 100000),
+              reference.findRange(low, low + 100000));
+  }
+}
+
+}  // namespace
+
+TEST(Allocation, TransparentHugePages) {
+  BloomFilterRFParameters params{1 << 22, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  params.memory.pages = Pages::Transparent;
+  BloomRF<uint64_t> bf{params};
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(bf.getFilter().get()) %
+                detail::HUGE_PAGE_SIZE,
+            0);
+  ASSERT_EQ(bf.getFilter().get_deleter().mappedBytes, 2 * (1 << 21));
+  checkMemoryPolicy(params.memory);
+
+  BloomRFShardSet<uint64_t> set{params, 3};
+  set.add(2, 42);
+  ASSERT_EQ(set.find(42)[0], 0b100);
+}
+
+TEST(Allocation, HugeTLBPagesNeedAReservedPool) {
+  MemoryPolicy policy{Pages::HugeTLB};
+  try {
+    BloomFilterRFParameters params{16000, 0, {7, 7, 7, 7}};
+    params.memory = policy;
+    BloomRF<uint64_t> huge{params};
+  } catch (const std::system_error&) {
+    GTEST_SKIP() << "No huge pages are reserved.";
+  }
+  checkMemoryPolicy(policy);
+}
+
+TEST(Allocation, NumaPlacement) {
+  try {
+    checkMemoryPolicy({Pages::Default, NumaPlacement::Bind, {0}});
+    checkMemoryPolicy({Pages::Transparent, NumaPlacement::Interleave, {0}});
+  } catch (const std::system_error&) {
+    GTEST_SKIP() << "The kernel does not support NUMA policies.";
+  }
+}
+
+TEST(Allocation, InvalidNumaNodes) {
+  BloomFilterRFParameters params{16000, 0, {7, 7, 7, 7}};
+  params.memory.numa = NumaPlacement::Interleave;
+  ASSERT_THROW(BloomRF<uint64_t>{params}, std::logic_error);
+  params.memory.nodes = {-1};
+  ASSERT_THROW(BloomRF<uint64_t>{params}, std::logic_error);
+  params.memory.numa = NumaPlacement::FirstTouch;
+  params.memory.nodes = {0};
+  ASSERT_THROW(BloomRF<uint64_t>{params}, std::logic_error);
+}
+#else
+TEST(Allocation, PoliciesNeedLinux) {
+  BloomFilterRFParameters params{16000, 0, {7, 7, 7, 7}};
+  params.memory.pages = Pages::Transparent;
+  ASSERT_THROW(BloomRF<uint64_t>{params}, std::logic_error);
+  params.memory = {Pages::Default, NumaPlacement::Interleave, {0}};
+  ASSERT_THROW(BloomRF<uint64_t>{params}, std::logic_error);
+}
+#endif
+
+}  // namespace test
+}  // namespace filters
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+constexpr size_t THREADS = 4;
+
+std::vector<uint64_t> randomKeys(size_t n, uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::vector<uint64_t> keys(n);
+  for (auto& key : keys) {
+    key = gen();
+  }
+  return keys;
+}
+
+}  // namespace
+
+TEST(Concurrent, AddConcurrentMatchesAdd) {
+  BloomFilterRFParameters params{16000, 0, {9, 8, 6, 4, 3, 2}};
+  BloomRF<uint64_t> sequential{params};
+  BloomRF<uint64_t> concurrent{params};
+  BloomRF<uint64_t> batched{params};
+
+  std::vector<uint64_t> keys = randomKeys(4000, 1);
+  for (auto key : keys) {
+    sequential.add(key);
+  }
+
+  std::vector<std::thread> threads;
+  size_t slice = keys.size() / THREADS;
+  for (size_t t = 0; t < THREADS; ++t) {
+    std::span<const uint64_t> part(keys.data() + t * slice, slice);
+    threads.emplace_back([&, part]() {
+      for (auto key : part) {
+        concurrent.addConcurrent(key);
+      }
+      batched.addBatchConcurrent(part);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < params.filter_size / sizeof(uint64_t); ++i) {
+    ASSERT_EQ(sequential.getFilter()[i], concurrent.getFilter()[i]);
+    ASSERT_EQ(sequential.getFilter()[i], batched.getFilter()[i]);
+  }
+}
+
+TEST(Concurrent, ReadersSeeCompletedAdds) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{16000, 0, {9, 8, 6, 4, 3, 2}}};
+
+  std::vector<std::vector<uint64_t>> keys;
+  std::vector<std::atomic<size_t>> published(THREADS);
+  for (size_t t = 0; t < THREADS; ++t) {
+    keys.push_back(randomKeys(1000, t + 10));
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < keys[t].size(); ++i) {
+        bf.addConcurrent(keys[t][i]);
+        published[t].store(i + 1, std::memory_order_release);
+      }
+    });
+  }
+
+  std::atomic<bool> falseNegative{false};
+  for (size_t t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&, t]() {
+      size_t checked = 0;
+      while (checked < keys[t].size()) {
+        size_t available = published[t].load(std::memory_order_acquire);
+        for (; checked < available; ++checked) {
+          uint64_t key = keys[t][checked];
+          if (!bf.find(key) || !bf.findRange(key - 10, key + 10)) {
+            falseNegative = true;
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_FALSE(falseNegative);
+}
+
+TEST(Concurrent, WideRangesDuringAdds) {
+  // PMHF words of 2048 and 512 bits, so that wide ranges test many words of
+  // a layer at once.  Run under -DSANITIZE=thread to check that lookups and
+  // addConcurrent do not race.
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{64000, 0, {12, 10, 8, 6, 4, 3, 2}}};
+  std::vector<uint64_t> keys = randomKeys(4000, 20);
+  std::atomic<size_t> published{0};
+
+  std::thread writer([&]() {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      bf.addConcurrent(keys[i]);
+      published.store(i + 1, std::memory_order_release);
+    }
+  });
+
+  bool falseNegative = false;
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  std::unique_ptr<bool[]> out(new bool[keys.size()]);
+  size_t checked = 0;
+  while (checked < keys.size()) {
+    size_t available = published.load(std::memory_order_acquire);
+    for (; checked < available; ++checked) {
+      uint64_t key = keys[checked];
+      uint64_t low = key - std::min<uint64_t>(key, uint64_t{1} << 30);
+      falseNegative = falseNegative || !bf.findRange(low, key + 1000000);
+      ranges.emplace_back(low, key);
+    }
+    bf.findRangeBatch(ranges, out.get());
+    falseNegative = falseNegative ||
+                    std::count(out.get(), out.get() + ranges.size(), false);
+  }
+  writer.join();
+  ASSERT_FALSE(falseNegative);
+}
+
+TEST(Concurrent, SignedAndFloatKeys) {
+  BloomRF<int64_t> sbf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  BloomRF<double> fbf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+
+  std::vector<int64_t> signedKeys{-5, 0, 7, -1000000};
+  std::vector<double> floatKeys{-0.5, 0.0, 3.25, 1e100};
+  std::thread writer([&]() {
+    sbf.addBatchConcurrent(signedKeys);
+    fbf.addBatchConcurrent(floatKeys);
+  });
+  sbf.addConcurrent(42);
+  fbf.addConcurrent(-42.0);
+  writer.join();
+
+  for (auto key : signedKeys) {
+    ASSERT_TRUE(sbf.find(key));
+  }
+  for (auto key : floatKeys) {
+    ASSERT_TRUE(fbf.find(key));
+  }
+  ASSERT_TRUE(sbf.find(42));
+  ASSERT_TRUE(fbf.find(-42.0));
+}
+
+TEST(Parallel, AddBatchParallelMatchesAdd) {
+  BloomFilterRFParameters params{400000, 0, {9, 8, 6, 4, 3, 2}};
+  BloomRF<uint64_t> sequential{params};
+
+  // Enough keys for 4 slices of detail::PARALLEL_MIN_KEYS, as a sorted run.
+  std::vector<uint64_t> keys = randomKeys(300000, 2);
+  std::sort(keys.begin(), keys.end());
+  sequential.addBatch(keys);
+
+  for (size_t threads : {1, 3, 8}) {
+    BloomRF<uint64_t> parallel{params};
+    parallel.addBatchParallel(keys, threads);
+    for (size_t i = 0; i < params.filter_size / sizeof(uint64_t); ++i) {
+      ASSERT_EQ(sequential.getFilter()[i], parallel.getFilter()[i])
+          << threads << " threads";
+    }
+  }
+}
+
+TEST(Parallel, SignedAndFloatKeys) {
+  std::vector<uint64_t> keys = randomKeys(200000, 3);
+  std::vector<int32_t> signedKeys(keys.begin(), keys.end());
+  std::vector<float> floatKeys(keys.size());
+  std::transform(keys.begin(), keys.end(), floatKeys.begin(),
+                 [](uint64_t key) { return static_cast<float>(key) - 1e19f; });
+
+  BloomRF<int32_t> sbf{BloomFilterRFParameters{200000, 0, {6, 5, 4, 3}}};
+  BloomRF<float> fbf{BloomFilterRFParameters{200000, 0, {6, 5, 4, 3}}};
+  sbf.addBatchParallel(signedKeys, 4);
+  fbf.addBatchParallel(floatKeys);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_TRUE(sbf.find(signedKeys[i]));
+    ASSERT_TRUE(fbf.find(floatKeys[i]));
+  }
+
+  EXPECT_THROW(sbf.addBatchParallel(signedKeys, 0), std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters
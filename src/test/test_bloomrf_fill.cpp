@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+/// Fraction of absent keys, or of empty ranges of width keys, that bf finds.
+double measuredFpr(const BloomRF<uint64_t>& bf,
+                   std::vector<uint64_t> keys,
+                   uint64_t width) {
+  std::sort(keys.begin(), keys.end());
+  std::mt19937_64 gen(42);
+  size_t queries = 0, found = 0;
+  while (queries < 100000) {
+    uint64_t low = gen() % (~uint64_t{0} - width);
+    uint64_t high = low + (width - 1);
+    auto lb = std::lower_bound(keys.begin(), keys.end(), low);
+    if (lb != keys.end() && *lb <= high) {
+      continue;
+    }
+    ++queries;
+    found += width == 1 ? bf.find(low) : bf.findRange(low, high);
+  }
+  return static_cast<double>(found) / queries;
+}
+
+}  // namespace
+
+TEST(FillEstimate, EmptyFilter) {
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{4000, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  auto fill = bf.estimateFill();
+  ASSERT_EQ(fill.fill, 0);
+  ASSERT_EQ(fill.layers, std::vector<double>(8, 0.0));
+  ASSERT_EQ(fill.keys, 0);
+  ASSERT_EQ(fill.pointFpr, 0);
+  ASSERT_EQ(bf.estimateRangeFpr(1000), 0);
+  ASSERT_THROW(bf.estimateRangeFpr(0), std::logic_error);
+}
+
+TEST(FillEstimate, CountsSetBitsAndKeys) {
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{40000, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  std::mt19937_64 gen(1);
+  std::vector<uint64_t> keys(20000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  bf.addBatch(keys);
+
+  size_t bits = 0;
+  for (size_t i = 0; i < 40000 / sizeof(uint64_t); ++i) {
+    bits += std::popcount(bf.getFilter()[i]);
+  }
+  auto fill = bf.estimateFill();
+  ASSERT_DOUBLE_EQ(fill.fill, bits / (8.0 * 40000));
+  ASSERT_EQ(fill.layers, std::vector<double>(8, fill.fill));
+  ASSERT_NEAR(fill.keys, 20000, 1000);
+}
+
+TEST(FillEstimate, EstimatesTrackMeasuredRates) {
+  std::vector<BloomFilterRFParameters> configs{
+      {200000, 0, {7, 7, 7, 4, 4, 2, 2, 2}},
+      {100000, 0, {7, 7, 7, 4, 4, 2, 2, 2}},
+      {200000, 0, {7, 7, 7, 4, 4, 2, 2, 2}, Layout::Flat, 0,
+       {12800, 12800, 12800, 25600, 25600, 25600, 38400, 46400}}};
+  std::mt19937_64 gen(2);
+  std::vector<uint64_t> keys(100000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  for (const auto& params : configs) {
+    BloomRF<uint64_t> bf{params};
+    bf.addBatch(keys);
+    auto fill = bf.estimateFill();
+    ASSERT_NEAR(fill.keys, keys.size(), keys.size() / 20);
+
+    double point = measuredFpr(bf, keys, 1);
+    ASSERT_GT(fill.pointFpr, point / 1.5);
+    ASSERT_LT(fill.pointFpr, point * 1.5);
+    // Range estimates err on the high side.
+    for (uint64_t width : {uint64_t{1} << 10, uint64_t{1} << 20}) {
+      double range = measuredFpr(bf, keys, width);
+      double estimate = bf.estimateRangeFpr(width, fill);
+      ASSERT_GT(estimate, range * 0.8) << "width " << width;
+      ASSERT_LT(estimate, range * 4) << "width " << width;
+    }
+  }
+}
+
+TEST(FillEstimate, LayerSubArrays) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      8192, 0, {8, 8, 8, 8}, Layout::Flat, 0, {4096, 2048, 1024, 1024}}};
+  std::mt19937_64 gen(3);
+  for (size_t i = 0; i < 2000; ++i) {
+    bf.add(gen());
+  }
+  auto fill = bf.estimateFill();
+  // Every layer sets a bit per key, so the smallest sub-array fills most.
+  ASSERT_GT(fill.layers[3], fill.layers[0]);
+  double bits = 0;
+  size_t sizes[] = {4096, 2048, 1024, 1024};
+  for (size_t i = 0; i < 4; ++i) {
+    bits += fill.layers[i] * sizes[i];
+  }
+  ASSERT_DOUBLE_EQ(fill.fill, bits / 8192);
+}
+
+TEST(FillEstimate, ConvertedKeysAndViews) {
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  BloomRF<int64_t> sbf{params};
+  for (int64_t key = -1000; key < 1000; ++key) {
+    sbf.add(key * 1000);
+  }
+  std::vector<char> buffer = sbf.serialize();
+  BloomRFView<int64_t> view{buffer};
+  auto fill = sbf.estimateFill();
+  ASSERT_GT(fill.fill, 0);
+  ASSERT_EQ(view.estimateFill().fill, fill.fill);
+  ASSERT_EQ(view.estimateRangeFpr(100), sbf.estimateRangeFpr(100));
+}
+
+}  // namespace test
+}  // namespace filters
@@ -132,5 +132,47 @@ TEST(OneOffFloat, RangeQuery) {
   ASSERT_TRUE(bf.findRange(key - .0001, key + .0001));
 }
 
+TEST(BatchFloat, AddBatchMatchesAdd) {
+  BloomFilterRFParameters params{16000, 0, {7, 6, 6, 4, 3}};
+  BloomRF<float> bf{params};
+  BloomRF<float> batched{params};
+
+  std::vector<float> keys(1000);
+  std::generate(keys.begin(), keys.end(),
+                []() { return randomUniformFloat(-1e6f, 1e6f); });
+
+  for (auto key : keys) {
+    bf.add(key);
+  }
+  batched.addBatch(keys);
+
+  size_t words = (params.filter_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  for (size_t i = 0; i < words; ++i) {
+    ASSERT_EQ(bf.getFilter()[i], batched.getFilter()[i]);
+  }
+  for (auto key : keys) {
+    ASSERT_TRUE(batched.find(key));
+  }
+}
+
+TEST(BatchFloat, FindBatchMatchesFind) {
+  BloomRF<double> bf{BloomFilterRFParameters{4000, 0, {9, 8, 6, 4, 3, 2}}};
+
+  std::vector<double> keys(1000);
+  std::generate(keys.begin(), keys.end(),
+                []() { return randomUniformFloat(-1e6, 1e6); });
+  bf.addBatch(keys);
+
+  std::vector<double> queries(keys.begin(), keys.begin() + 500);
+  std::generate_n(std::back_inserter(queries), 500,
+                  []() { return randomUniformFloat(-1e6, 1e6); });
+
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  bf.findBatch(queries, out.get());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    ASSERT_EQ(bf.find(queries[i]), out[i]);
+  }
+}
+
 }  // namespace test
 }  // namespace filters
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+template <typename Key>
+std::vector<Key> randomKeys(size_t n, uint64_t seed) {
+  std::mt19937_64 gen(seed);
+  std::vector<Key> keys(n);
+  if constexpr (std::is_floating_point_v<Key>) {
+    std::uniform_real_distribution<Key> dist(-1e6, 1e6);
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  } else {
+    std::uniform_int_distribution<Key> dist(std::numeric_limits<Key>::min(),
+                                            std::numeric_limits<Key>::max());
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  }
+  return keys;
+}
+
+template <typename UnderType, typename Filter>
+void expectSameWords(const Filter& a, const Filter& b, size_t filterSize) {
+  for (size_t i = 0; i < filterSize / sizeof(UnderType); ++i) {
+    ASSERT_EQ(a.getFilter()[i], b.getFilter()[i]);
+  }
+}
+
+}  // namespace
+
+TEST(Merge, MergeFromMatchesAddingAllKeys) {
+  std::vector<BloomFilterRFParameters> configs{
+      {4000, 3, {7, 7, 7, 4, 4, 2, 2, 2}},
+      {4096, 3, {9, 8, 6, 4, 3, 2}, Layout::Blocked},
+      {4000, 3, {6, 4, 3, 2}, Layout::Flat, 0, {2000, 1000, 900, 100}}};
+  for (const auto& params : configs) {
+    BloomRF<uint64_t> a{params};
+    BloomRF<uint64_t> b{params};
+    BloomRF<uint64_t> all{params};
+    auto keysA = randomKeys<uint64_t>(500, 1);
+    auto keysB = randomKeys<uint64_t>(500, 2);
+    a.addBatch(keysA);
+    b.addBatch(keysB);
+    all.addBatch(keysA);
+    all.addBatch(keysB);
+
+    a.mergeFrom(b);
+    expectSameWords<uint64_t>(a, all, params.filter_size);
+    for (auto key : keysB) {
+      ASSERT_TRUE(a.find(key));
+      ASSERT_TRUE(a.findRange(key, key));
+    }
+  }
+}
+
+TEST(Merge, IntersectKeepsCommonKeys) {
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 4, 4, 2, 2, 2}};
+  BloomRF<uint64_t> a{params};
+  BloomRF<uint64_t> b{params};
+  auto common = randomKeys<uint64_t>(300, 1);
+  auto onlyA = randomKeys<uint64_t>(300, 2);
+  auto onlyB = randomKeys<uint64_t>(300, 3);
+  a.addBatch(common);
+  a.addBatch(onlyA);
+  b.addBatch(common);
+  b.addBatch(onlyB);
+
+  a.intersect(b);
+  for (auto key : common) {
+    ASSERT_TRUE(a.find(key));
+    ASSERT_TRUE(a.findRange(key - 10, key + 10));
+  }
+  // Most keys of only one filter lose a bit on some layer.
+  size_t found = std::count_if(onlyA.begin(), onlyA.end(),
+                               [&](uint64_t key) { return a.find(key); });
+  ASSERT_LT(found, onlyA.size() / 2);
+}
+
+TEST(Merge, SmallUnderTypeAndConvertedKeys) {
+  // 1000 bytes leave a tail that does not fill a vector.
+  BloomFilterRFParameters params{1000, 0, {6, 4, 3, 2}};
+  BloomRF<uint64_t, uint32_t> a{params};
+  BloomRF<uint64_t, uint32_t> b{params};
+  BloomRF<uint64_t, uint32_t> all{params};
+  auto keysA = randomKeys<uint64_t>(200, 1);
+  auto keysB = randomKeys<uint64_t>(200, 2);
+  a.addBatch(keysA);
+  b.addBatch(keysB);
+  all.addBatch(keysA);
+  all.addBatch(keysB);
+  a.mergeFrom(b);
+  expectSameWords<uint32_t>(a, all, params.filter_size);
+
+  BloomRF<int64_t> sa{params};
+  BloomRF<int64_t> sb{params};
+  BloomRF<double> fa{params};
+  BloomRF<double> fb{params};
+  auto keys = randomKeys<int64_t>(200, 3);
+  auto floats = randomKeys<double>(200, 4);
+  sb.addBatch(keys);
+  fb.addBatch(floats);
+  sa.mergeFrom(sb);
+  fa.mergeFrom(fb);
+  for (auto key : keys) {
+    ASSERT_TRUE(sa.find(key));
+  }
+  for (auto key : floats) {
+    ASSERT_TRUE(fa.find(key));
+  }
+}
+
+TEST(Merge, RejectsDifferentConfigurations) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  std::vector<BloomFilterRFParameters> others{
+      {4000, 1, {6, 4, 3, 2}},
+      {4000, 0, {6, 4, 3, 3}},
+      {4096, 0, {6, 4, 3, 2}},
+      {4096, 0, {6, 4, 3, 2}, Layout::Blocked},
+      {4000, 0, {6, 4, 3, 2}, Layout::Flat, 0, {1000, 1000, 1000, 1000}}};
+  BloomFilterRFParameters fastRange{4000, 0, {6, 4, 3, 2}};
+  fastRange.reduction = IndexReduction::MultiplyShift;
+  others.push_back(fastRange);
+  for (const auto& params : others) {
+    BloomRF<uint64_t> other{params};
+    EXPECT_THROW(bf.mergeFrom(other), std::logic_error);
+    EXPECT_THROW(bf.intersect(other), std::logic_error);
+  }
+}
+
+}  // namespace test
+}  // namespace filters
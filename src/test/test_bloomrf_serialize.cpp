@@ -0,0 +1,310 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include "gtest/gtest.h"
+
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+template <typename Key_,
+          typename UnderType_ = uint64_t,
+          typename HashPolicy = CityHashPolicy>
+struct FilterConfig {
+  using Key = Key_;
+  using UnderType = UnderType_;
+  using Filter = BloomRF<Key, UnderType, HashPolicy>;
+};
+
+template <typename Key>
+std::vector<Key> randomKeys(size_t n) {
+  static std::mt19937_64 gen(42);
+  std::vector<Key> keys(n);
+  if constexpr (std::is_floating_point_v<Key>) {
+    std::uniform_real_distribution<Key> dist(-1e6, 1e6);
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  } else {
+    std::uniform_int_distribution<Key> dist(std::numeric_limits<Key>::min(),
+                                            std::numeric_limits<Key>::max());
+    std::generate(keys.begin(), keys.end(), [&]() { return dist(gen); });
+  }
+  return keys;
+}
+
+/// An input stream buffer that cannot seek, like that of a pipe.
+class UnseekableBuffer : public std::streambuf {
+ public:
+  explicit UnseekableBuffer(std::string data_) : data(std::move(data_)) {
+    setg(data.data(), data.data(), data.data() + data.size());
+  }
+
+ private:
+  std::string data;
+};
+
+}  // namespace
+
+template <typename Config>
+class SerializationTest : public ::testing::Test {
+ protected:
+  using Key = typename Config::Key;
+  using Filter = typename Config::Filter;
+
+  void SetUp() override {
+    for (auto key : keys) {
+      bf.add(key);
+    }
+  }
+
+  void expectSameFilter(const Filter& other) {
+    using UnderType = typename Config::UnderType;
+    size_t words =
+        (params.filter_size + sizeof(UnderType) - 1) / sizeof(UnderType);
+    for (size_t i = 0; i < words; ++i) {
+      ASSERT_EQ(bf.getFilter()[i], other.getFilter()[i]);
+    }
+    for (auto key : keys) {
+      ASSERT_TRUE(other.find(key));
+      ASSERT_TRUE(other.findRange(key, key));
+    }
+  }
+
+  BloomFilterRFParameters params{4000, 7, {6, 4, 3, 2}};
+  Filter bf{params};
+  std::vector<Key> keys = randomKeys<Key>(1000);
+};
+
+using SerializedFilters =
+    ::testing::Types<FilterConfig<uint64_t>,
+                     FilterConfig<uint64_t, uint32_t>,
+                     FilterConfig<uint16_t>,
+                     FilterConfig<int32_t>,
+                     FilterConfig<int64_t>,
+                     FilterConfig<float>,
+                     FilterConfig<double>,
+                     FilterConfig<uint64_t, uint64_t, MixHashPolicy>>;
+TYPED_TEST_SUITE(SerializationTest, SerializedFilters);
+
+TYPED_TEST(SerializationTest, StreamRoundTrip) {
+  std::stringstream stream;
+  this->bf.serialize(stream);
+  auto copy = TestFixture::Filter::deserialize(stream);
+  this->expectSameFilter(copy);
+}
+
+TYPED_TEST(SerializationTest, BufferRoundTrip) {
+  std::vector<char> buffer = this->bf.serialize();
+  auto copy = TestFixture::Filter::deserialize(buffer);
+  this->expectSameFilter(copy);
+}
+
+TYPED_TEST(SerializationTest, StreamAndBufferFormatsMatch) {
+  std::stringstream stream;
+  this->bf.serialize(stream);
+  std::string streamed = stream.str();
+  std::vector<char> buffer = this->bf.serialize();
+  ASSERT_EQ(std::vector<char>(streamed.begin(), streamed.end()), buffer);
+}
+
+TYPED_TEST(SerializationTest, DetectsCorruption) {
+  std::vector<char> buffer = this->bf.serialize();
+  buffer[buffer.size() / 2] ^= 1;
+  ASSERT_THROW(TestFixture::Filter::deserialize(buffer), std::runtime_error);
+}
+
+TYPED_TEST(SerializationTest, DetectsTruncation) {
+  std::vector<char> buffer = this->bf.serialize();
+  buffer.pop_back();
+  ASSERT_THROW(TestFixture::Filter::deserialize(buffer), std::runtime_error);
+
+  std::stringstream stream(std::string(buffer.begin(), buffer.begin() + 10));
+  ASSERT_THROW(TestFixture::Filter::deserialize(stream), std::runtime_error);
+}
+
+TEST(Serialization, UnseekableStreamRoundTrip) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  bf.add(42);
+  std::vector<char> buffer = bf.serialize();
+  UnseekableBuffer unseekable(std::string(buffer.begin(), buffer.end()));
+  std::istream in(&unseekable);
+  ASSERT_TRUE(BloomRF<uint64_t>::deserialize(in).find(42));
+}
+
+TEST(Serialization, HugeSizeOfShortInputIsTruncated) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  std::vector<char> buffer = bf.serialize();
+  // Keep the header, which is padded to 64 bytes, and claim 2^37 words.
+  buffer.resize(64);
+  uint64_t words = uint64_t{1} << 37;
+  for (size_t i = 0; i < sizeof(words); ++i) {
+    buffer[20 + i] = static_cast<char>(words >> (8 * i));
+  }
+
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(buffer), std::runtime_error);
+  std::stringstream stream(std::string(buffer.begin(), buffer.end()));
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(stream), std::runtime_error);
+  UnseekableBuffer unseekable(std::string(buffer.begin(), buffer.end()));
+  std::istream in(&unseekable);
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(in), std::runtime_error);
+}
+
+TEST(Serialization, RejectsCorruptDeltaVectors) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  std::vector<char> buffer = bf.serialize();
+  // Offset 11 holds the number of layers, offset 28 the first delta.
+  for (auto [offset, value] : {std::pair<size_t, char>{11, 0},
+                               {28, 0},
+                               {28, 62}}) {
+    std::vector<char> corrupt = buffer;
+    corrupt[offset] = value;
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(corrupt), std::runtime_error);
+    std::stringstream stream(std::string(corrupt.begin(), corrupt.end()));
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(stream), std::runtime_error);
+    ASSERT_THROW(BloomRFView<uint64_t>{corrupt}, std::runtime_error);
+  }
+}
+
+TEST(Serialization, RejectsPmhfWordsWiderThanTheFilter) {
+  // One word of 64 bits, which a layer with delta 8 cannot hash into.
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{8, 0, {6, 4}}};
+  std::vector<char> buffer = bf.serialize();
+  for (char delta : {8, 20}) {
+    std::vector<char> corrupt = buffer;
+    corrupt[28] = delta;
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(corrupt), std::runtime_error);
+    std::stringstream stream(std::string(corrupt.begin(), corrupt.end()));
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(stream), std::runtime_error);
+    ASSERT_THROW(BloomRFView<uint64_t>{corrupt}, std::runtime_error);
+  }
+}
+
+TEST(Serialization, RejectsMismatchedTypes) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  std::vector<char> buffer = bf.serialize();
+
+  ASSERT_THROW(BloomRF<int64_t>::deserialize(buffer), std::runtime_error);
+  ASSERT_THROW(BloomRF<double>::deserialize(buffer), std::runtime_error);
+  ASSERT_THROW((BloomRF<uint64_t, uint32_t>::deserialize(buffer)),
+               std::runtime_error);
+  ASSERT_THROW(
+      (BloomRF<uint64_t, uint64_t, MixHashPolicy>::deserialize(buffer)),
+      std::runtime_error);
+  ASSERT_NO_THROW(BloomRF<uint64_t>::deserialize(buffer));
+
+  std::vector<char> garbage(100, 'x');
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(garbage), std::runtime_error);
+}
+
+TEST(Serialization, BlockedLayoutRoundTrip) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      4000, 0, {6, 4, 3, 2}, Layout::Blocked, 2}};
+  std::vector<uint64_t> keys = randomKeys<uint64_t>(500);
+  bf.addBatch(keys);
+
+  std::vector<char> buffer = bf.serialize();
+  auto copy = BloomRF<uint64_t>::deserialize(buffer);
+  // The layout is part of the serialized configuration.
+  ASSERT_EQ(copy.serialize(), buffer);
+  for (auto key : keys) {
+    ASSERT_TRUE(copy.find(key));
+    ASSERT_TRUE(copy.findRange(key, key));
+  }
+}
+
+TEST(Serialization, LayerSizesRoundTrip) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      4000, 0, {6, 4, 3, 2}, Layout::Flat, 0, {2000, 1000, 900, 100}}};
+  std::vector<uint64_t> keys = randomKeys<uint64_t>(500);
+  bf.addBatch(keys);
+
+  std::vector<char> buffer = bf.serialize();
+  auto copy = BloomRF<uint64_t>::deserialize(buffer);
+  // The sub-arrays are part of the serialized configuration.
+  ASSERT_EQ(copy.serialize(), buffer);
+  BloomRFView<uint64_t> view{buffer};
+  for (auto key : keys) {
+    ASSERT_TRUE(copy.find(key));
+    ASSERT_TRUE(copy.findRange(key, key));
+    ASSERT_TRUE(view.find(key));
+  }
+
+  // Sub-arrays that do not add up to the filter are rejected.  The first
+  // layer size follows the header, the delta and three option bytes.
+  size_t firstLayer = 28 + 4 + 3;
+  buffer[firstLayer] ^= 1;
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(buffer), std::runtime_error);
+}
+
+TEST(Serialization, RejectsLayerSizesThatTheFilterWouldRound) {
+  // Two layers of 64 words, whose sizes follow the header, the delta and
+  // three option bytes.
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{
+      1024, 0, {6, 4}, Layout::Flat, 0, {512, 512}}};
+  std::vector<char> buffer = bf.serialize();
+  size_t firstLayer = 28 + 2 + 3;
+  auto setLayerWords = [&](std::vector<char>& corrupt, size_t layer,
+                           uint64_t words) {
+    for (size_t i = 0; i < sizeof(words); ++i) {
+      corrupt[firstLayer + 8 * layer + i] = static_cast<char>(words >> (8 * i));
+    }
+  };
+
+  // A PMHF word of 2^39 bits would round each layer up to 2^33 words.
+  std::vector<char> wide = buffer;
+  wide[28] = 40;
+  // Layers that are not whole cache lines.
+  std::vector<char> unaligned = buffer;
+  setLayerWords(unaligned, 0, 60);
+  setLayerWords(unaligned, 1, 68);
+  for (const auto& corrupt : {wide, unaligned}) {
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(corrupt), std::runtime_error);
+    std::stringstream stream(std::string(corrupt.begin(), corrupt.end()));
+    ASSERT_THROW(BloomRF<uint64_t>::deserialize(stream), std::runtime_error);
+    ASSERT_THROW(BloomRFView<uint64_t>{corrupt}, std::runtime_error);
+  }
+}
+
+TEST(Serialization, IndexReductionRoundTrip) {
+  for (auto reduction :
+       {IndexReduction::MultiplyShift, IndexReduction::PowerOfTwo}) {
+    BloomFilterRFParameters params{4000, 0, {6, 4, 3, 2}};
+    params.reduction = reduction;
+    BloomRF<uint64_t> bf{params};
+    std::vector<uint64_t> keys = randomKeys<uint64_t>(500);
+    bf.addBatch(keys);
+
+    std::vector<char> buffer = bf.serialize();
+    auto copy = BloomRF<uint64_t>::deserialize(buffer);
+    // The reduction is part of the serialized configuration.
+    ASSERT_EQ(copy.serialize(), buffer);
+    BloomRFView<uint64_t> view{buffer};
+    for (auto key : keys) {
+      ASSERT_TRUE(copy.find(key));
+      ASSERT_TRUE(copy.findRange(key, key));
+      ASSERT_TRUE(view.find(key));
+    }
+  }
+}
+
+TEST(Serialization, PowerOfTwoReductionRoundsFilterSize) {
+  // 500 words are rounded up to 512, which follow the 64 byte header.
+  BloomFilterRFParameters params{4000, 0, {6, 4, 3, 2}};
+  params.reduction = IndexReduction::PowerOfTwo;
+  BloomRF<uint64_t> bf{params};
+  ASSERT_EQ(bf.serialize().size(), 64 + 512 * sizeof(uint64_t) + 8);
+}
+
+}  // namespace test
+}  // namespace filters
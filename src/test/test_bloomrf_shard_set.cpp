@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "bloomRF/bloomRFShardSet.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+using ShardSet = BloomRFShardSet<uint64_t>;
+
+/// Fills shards of set and as many independent filters with the same keys.
+std::vector<BloomRF<uint64_t>> fillShards(ShardSet& set,
+                                          const BloomFilterRFParameters& params,
+                                          size_t keysPerShard,
+                                          std::mt19937_64& gen) {
+  std::vector<BloomRF<uint64_t>> filters;
+  for (size_t s = 0; s < set.numShards(); ++s) {
+    filters.emplace_back(params);
+    std::vector<uint64_t> keys(keysPerShard);
+    std::generate(keys.begin(), keys.end(),
+                  [&]() { return gen() % (uint64_t{1} << 40); });
+    filters.back().addBatch(keys);
+    set.addBatch(s, keys);
+  }
+  return filters;
+}
+
+}  // namespace
+
+TEST(ShardSet, MatchesIndependentFilters) {
+  std::vector<BloomFilterRFParameters> configs{
+      {4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}},
+      // PMHF words wider than a UnderType.
+      {16000, 0, {10, 8, 6, 4, 3, 2, 10, 10}},
+      {8192, 0, {6, 6, 6, 6, 6, 6, 7, 7, 7}, Layout::Blocked},
+      {8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}, Layout::Flat, 0,
+       {2000, 2000, 1000, 1000, 500, 500, 500, 250, 250},
+       IndexReduction::MultiplyShift}};
+  std::mt19937_64 gen(1);
+  for (const auto& params : configs) {
+    // More than 64 shards, so that bitmaps have several words.
+    ShardSet set{params, 100};
+    auto filters = fillShards(set, params, 50, gen);
+
+    for (size_t i = 0; i < 300; ++i) {
+      uint64_t low = gen() % (uint64_t{1} << 40);
+      uint64_t high = low + gen() % (uint64_t{1} << (gen() % 30));
+      auto point = set.find(low);
+      auto range = set.findRange(low, high);
+      ASSERT_EQ(range.size(), 2);
+      for (size_t s = 0; s < filters.size(); ++s) {
+        ASSERT_EQ(ShardSet::contains(point, s), filters[s].find(low));
+        ASSERT_EQ(ShardSet::contains(range, s),
+                  filters[s].findRange(low, high));
+      }
+    }
+  }
+}
+
+TEST(ShardSet, FindsEveryKey) {
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}};
+  ShardSet set{params, 3};
+  set.add(0, 100);
+  set.add(1, 200);
+  set.add(2, 100000);
+
+  auto shards = set.findRange(50, 250);
+  ASSERT_TRUE(ShardSet::contains(shards, 0));
+  ASSERT_TRUE(ShardSet::contains(shards, 1));
+  ASSERT_FALSE(ShardSet::contains(shards, 2));
+  ASSERT_EQ(set.find(100000)[0], 0b100);
+  ASSERT_EQ(set.findRange(0, ~uint64_t{0})[0], 0b111);
+  ASSERT_EQ(set.findRange(300, 5000)[0], 0);
+  ASSERT_THROW(set.findRange(2, 1), std::logic_error);
+  ASSERT_THROW(set.add(3, 1), std::out_of_range);
+  ASSERT_EQ(set.memoryBytes(), 3 * 4000);
+}
+
+TEST(ShardSet, AssignFilters) {
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}};
+  std::mt19937_64 gen(2);
+  ShardSet set{params, 70};
+  auto filters = fillShards(set, params, 20, gen);
+
+  BloomRF<uint64_t> replacement{params};
+  replacement.add(uint64_t{1} << 50);
+  set.assign(69, replacement);
+  auto shards = set.find(uint64_t{1} << 50);
+  ASSERT_TRUE(ShardSet::contains(shards, 69));
+  ASSERT_EQ(ShardSet::contains(set.findRange(0, uint64_t{1} << 49), 69),
+            replacement.findRange(0, uint64_t{1} << 49));
+
+  ASSERT_THROW(
+      set.assign(0, BloomRF<uint64_t>{BloomFilterRFParameters{
+                        4000, 1, {7, 7, 7, 7, 7, 7, 7, 7, 7}}}),
+      std::logic_error);
+  ASSERT_THROW(set.assign(0, BloomRF<uint64_t>{BloomFilterRFParameters{
+                                 8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}}}),
+               std::logic_error);
+  ASSERT_THROW(ShardSet(params, 0), std::logic_error);
+}
+
+TEST(ShardSet, RejectsTooManyShards) {
+  // 500 words per shard, whose bytes for this many shards overflow size_t.
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}};
+  size_t shards = std::numeric_limits<size_t>::max() / 500 / 8 + 1;
+  ASSERT_THROW(ShardSet(params, shards), std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters
@@ -123,6 +123,66 @@ INSTANTIATE_TEST_SUITE_P(
       return ret;
     }()));
 
+TEST(BatchSigned, AddBatchMatchesAdd) {
+  BloomFilterRFParameters params{16000, 0, {9, 8, 6, 4, 3, 2}};
+  BloomRF<int64_t> bf{params};
+  BloomRF<int64_t> batched{params};
+
+  std::vector<int64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformInt64);
+
+  for (auto key : keys) {
+    bf.add(key);
+  }
+  batched.addBatch(keys);
+
+  size_t words = (params.filter_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  for (size_t i = 0; i < words; ++i) {
+    ASSERT_EQ(bf.getFilter()[i], batched.getFilter()[i]);
+  }
+  for (auto key : keys) {
+    ASSERT_TRUE(batched.find(key));
+    ASSERT_TRUE(batched.findRange(key - 1, key + 1));
+  }
+}
+
+TEST(BatchSigned, FindBatchMatchesFind) {
+  BloomRF<int64_t> bf{BloomFilterRFParameters{4000, 0, {9, 8, 6, 4, 3, 2}}};
+
+  std::vector<int64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformInt64);
+  bf.addBatch(keys);
+
+  std::vector<int64_t> queries(keys.begin(), keys.begin() + 500);
+  std::generate_n(std::back_inserter(queries), 500, randomUniformInt64);
+
+  std::unique_ptr<bool[]> out(new bool[queries.size()]);
+  bf.findBatch(queries, out.get());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    ASSERT_EQ(bf.find(queries[i]), out[i]);
+  }
+}
+
+TEST(BatchSigned, FindRangeBatchMatchesFindRange) {
+  BloomRF<int64_t> bf{BloomFilterRFParameters{4000, 0, {9, 8, 6, 4, 3, 2}}};
+
+  std::vector<int64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), randomUniformInt64);
+  bf.addBatch(keys);
+
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  for (size_t i = 0; i < 1000; ++i) {
+    int64_t low = i % 2 == 0 ? keys[i] - 10 : randomUniformInt64();
+    ranges.emplace_back(low, low + rand() % 10000);
+  }
+
+  std::unique_ptr<bool[]> out(new bool[ranges.size()]);
+  bf.findRangeBatch(ranges, out.get());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    ASSERT_EQ(bf.findRange(ranges[i].first, ranges[i].second), out[i]);
+  }
+}
+
 }  // namespace test
 
 }  // namespace filters
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+uint64_t sum(const QueryStats& stats, uint64_t QueryStats::Layer::*counter) {
+  uint64_t total = 0;
+  for (const auto& layer : stats.layers) {
+    total += layer.*counter;
+  }
+  return total;
+}
+
+}  // namespace
+
+TEST(QueryStats, EmptyFilterEndsNegative) {
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{4000, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  QueryStats stats;
+  std::mt19937_64 gen(1);
+  for (size_t i = 0; i < 100; ++i) {
+    uint64_t low = gen();
+    ASSERT_FALSE(bf.findRange(low, low + gen() % 1000000, stats));
+  }
+  ASSERT_EQ(stats.layers.size(), 8);
+  ASSERT_EQ(stats.queries, 100);
+  ASSERT_EQ(sum(stats, &QueryStats::Layer::negatives), 100);
+  ASSERT_EQ(sum(stats, &QueryStats::Layer::positives), 0);
+  // No bit is set, so the partial checks of the top layer end every query.
+  ASSERT_EQ(stats.layers[7].negatives, 100);
+  ASSERT_GE(sum(stats, &QueryStats::Layer::words),
+            sum(stats, &QueryStats::Layer::partialChecks) +
+                sum(stats, &QueryStats::Layer::coveredChecks));
+}
+
+TEST(QueryStats, ExitLayers) {
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3, 2}}};
+  bf.add(1000);
+  QueryStats stats;
+
+  // A single key is a covered check of the lowest layer only.
+  ASSERT_TRUE(bf.findRange(1000, 1000, stats));
+  ASSERT_EQ(stats.lastExitLayer, 0);
+  ASSERT_EQ(stats.layers[0].positives, 1);
+
+  // The whole domain is covered on the top layer.
+  ASSERT_TRUE(bf.findRange(0, std::numeric_limits<uint64_t>::max(), stats));
+  ASSERT_EQ(stats.lastExitLayer, 3);
+  ASSERT_EQ(stats.layers[3].positives, 1);
+  ASSERT_EQ(stats.queries, 2);
+}
+
+TEST(QueryStats, FalsePositiveNeedsAQuery) {
+  QueryStats stats;
+  ASSERT_THROW(stats.recordFalsePositive(), std::logic_error);
+  ASSERT_TRUE(stats.layers.empty());
+
+  // Counters set by hand may name a layer that layers does not have yet.
+  stats.queries = 1;
+  stats.lastExitLayer = 3;
+  stats.recordFalsePositive();
+  ASSERT_EQ(stats.layers.size(), 4);
+  ASSERT_EQ(stats.layers[3].falsePositives, 1);
+}
+
+TEST(QueryStats, MatchesFindRangeAndAttributesFalsePositives) {
+  BloomRF<uint64_t> bf{
+      BloomFilterRFParameters{2000, 0, {7, 7, 7, 4, 4, 2, 2, 2}}};
+  std::mt19937_64 gen(2);
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  bf.addBatch(keys);
+  std::sort(keys.begin(), keys.end());
+
+  QueryStats stats;
+  size_t positives = 0, falsePositives = 0;
+  for (size_t i = 0; i < 2000; ++i) {
+    uint64_t low = gen();
+    uint64_t high = low + gen() % (uint64_t{1} << 30);
+    if (high < low) {
+      high = std::numeric_limits<uint64_t>::max();
+    }
+    bool found = bf.findRange(low, high, stats);
+    ASSERT_EQ(found, bf.findRange(low, high));
+    auto lb = std::lower_bound(keys.begin(), keys.end(), low);
+    positives += found;
+    if (found && (lb == keys.end() || *lb > high)) {
+      stats.recordFalsePositive();
+      ++falsePositives;
+    }
+  }
+  ASSERT_GT(falsePositives, 0);
+  ASSERT_EQ(sum(stats, &QueryStats::Layer::positives), positives);
+  ASSERT_EQ(sum(stats, &QueryStats::Layer::negatives), 2000 - positives);
+  ASSERT_EQ(sum(stats, &QueryStats::Layer::falsePositives), falsePositives);
+}
+
+TEST(QueryStats, AggregatesAndConvertedKeys) {
+  BloomFilterRFParameters params{4000, 0, {6, 4, 3, 2}};
+  BloomRF<int64_t> sbf{params};
+  BloomRF<double> fbf{params};
+  sbf.add(-5);
+  fbf.add(-0.5);
+
+  QueryStats signedStats, floatStats;
+  ASSERT_TRUE(sbf.findRange(-10, 10, signedStats));
+  ASSERT_TRUE(fbf.findRange(-1.0, 1.0, floatStats));
+  std::vector<char> buffer = sbf.serialize();
+  BloomRFView<int64_t> view{buffer};
+  ASSERT_TRUE(view.findRange(-5, -5, signedStats));
+
+  signedStats += floatStats;
+  ASSERT_EQ(signedStats.queries, 3);
+  ASSERT_EQ(sum(signedStats, &QueryStats::Layer::positives), 3);
+}
+
+}  // namespace test
+}  // namespace filters
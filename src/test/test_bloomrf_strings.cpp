@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bloomRF/stringBloomRF.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+std::string randomString(std::mt19937_64& gen, size_t maxLength) {
+  std::string s(gen() % (maxLength + 1), '\0');
+  std::generate(s.begin(), s.end(), [&]() { return 'a' + gen() % 26; });
+  return s;
+}
+
+}  // namespace
+
+TEST(StringKeys, PrefixesPreserveOrder) {
+  using detail::bigEndianPrefix;
+  ASSERT_EQ(bigEndianPrefix<uint32_t>("ab"), 0x61620000);
+  ASSERT_EQ(bigEndianPrefix<uint32_t>("abcdef"), 0x61626364);
+  ASSERT_EQ(bigEndianPrefix<uint64_t>(""), 0);
+
+  std::mt19937_64 gen(1);
+  for (size_t i = 0; i < 10000; ++i) {
+    std::string a = randomString(gen, 20), b = randomString(gen, 20);
+    if (a > b) {
+      std::swap(a, b);
+    }
+    ASSERT_LE(bigEndianPrefix<uint64_t>(a), bigEndianPrefix<uint64_t>(b));
+    ASSERT_TRUE(bigEndianPrefix<unsigned __int128>(a) <=
+                bigEndianPrefix<unsigned __int128>(b));
+  }
+}
+
+TEST(StringKeys, NoFalseNegatives) {
+  BloomRF<std::string_view> bf{
+      BloomFilterRFParameters{8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}}};
+  std::mt19937_64 gen(2);
+  std::vector<std::string> strings(500);
+  std::generate(strings.begin(), strings.end(),
+                [&]() { return randomString(gen, 24); });
+  std::vector<std::string_view> keys(strings.begin(), strings.end());
+  bf.addBatch(keys);
+
+  std::unique_ptr<bool[]> out(new bool[keys.size()]);
+  bf.findBatch(keys, out.get());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_TRUE(out[i]);
+    ASSERT_TRUE(bf.find(keys[i]));
+    ASSERT_TRUE(bf.findRange(keys[i], keys[i]));
+    ASSERT_TRUE(bf.findPrefix(keys[i].substr(0, gen() % 5)));
+    std::string low = randomString(gen, 24);
+    std::string_view high = std::max<std::string_view>(low, keys[i]);
+    ASSERT_TRUE(bf.findRange(std::min<std::string_view>(low, keys[i]), high));
+  }
+}
+
+TEST(StringKeys, RangeAndPrefixQueries) {
+  BloomRF<std::string_view> bf{
+      BloomFilterRFParameters{8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}}};
+  bf.add("user:1000:name");
+  bf.add("user:2000:mail");
+  bf.add("zebra");
+
+  ASSERT_TRUE(bf.findPrefix("user:1"));
+  ASSERT_TRUE(bf.findPrefix("user:2000"));
+  ASSERT_TRUE(bf.findPrefix(""));
+  ASSERT_FALSE(bf.findPrefix("user:3"));
+  ASSERT_FALSE(bf.findPrefix("apple"));
+  ASSERT_TRUE(bf.findRange("user:1500", "user:2500"));
+  ASSERT_FALSE(bf.findRange("user:3", "user:9"));
+  ASSERT_TRUE(bf.findRange("y", "zz"));
+  ASSERT_THROW(bf.findRange("b", "a"), std::logic_error);
+}
+
+TEST(StringKeys, ExactKeysTellSharedPrefixesApart) {
+  BloomFilterRFParameters params{4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}};
+  BloomRF<std::string_view> prefixOnly{params};
+  BloomRF<std::string_view> exact{params, ExactKeyParameters{4000, 4}};
+  std::vector<std::string> added, absent;
+  for (size_t i = 0; i < 200; ++i) {
+    added.push_back("tenant42/" + std::to_string(2 * i));
+    absent.push_back("tenant42/" + std::to_string(2 * i + 1));
+  }
+  for (const auto& key : added) {
+    prefixOnly.add(key);
+    exact.add(key);
+  }
+
+  size_t prefixOnlyFound = 0, exactFound = 0;
+  for (const auto& key : absent) {
+    prefixOnlyFound += prefixOnly.find(key);
+    exactFound += exact.find(key);
+  }
+  // All keys share their first 8 bytes.
+  ASSERT_EQ(prefixOnlyFound, absent.size());
+  ASSERT_LT(exactFound, 10);
+  for (const auto& key : added) {
+    ASSERT_TRUE(exact.find(key));
+  }
+  ASSERT_TRUE(exact.findPrefix("tenant42/"));
+}
+
+TEST(StringKeys, WidePrefixesAndMerge) {
+  BloomFilterRFParameters params{
+      8000, 0, {8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}};
+  BloomRF<BytePrefix<16>> a{params, ExactKeyParameters{1024}};
+  BloomRF<BytePrefix<16>> b{params, ExactKeyParameters{1024}};
+  a.add("2024-01-01T00:00:00/a");
+  b.add("2024-06-01T12:00:00/b");
+
+  // 16 bytes tell the hours apart, 8 would stop at "2024-01-".
+  ASSERT_FALSE(a.findRange("2024-01-01T01", "2024-01-01T23"));
+  ASSERT_FALSE(b.find("2024-01-01T00:00:00/a"));
+  a.mergeFrom(b);
+  ASSERT_TRUE(a.find("2024-06-01T12:00:00/b"));
+  ASSERT_TRUE(a.findPrefix("2024-06-01T12"));
+
+  BloomRF<BytePrefix<16>> other{params};
+  ASSERT_THROW(a.mergeFrom(other), std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bloomRF/mappedFile.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+class ViewTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::mt19937_64 gen(7);
+    keys.resize(2000);
+    for (auto& key : keys) {
+      key = gen();
+      bf.add(key);
+    }
+    buffer = bf.serialize();
+  }
+
+  void expectSameAnswers(const BloomRFView<uint64_t>& view) {
+    std::mt19937_64 gen(11);
+    for (auto key : keys) {
+      ASSERT_TRUE(view.find(key));
+      ASSERT_TRUE(view.findRange(key - 5, key + 5));
+    }
+    for (size_t i = 0; i < 2000; ++i) {
+      uint64_t key = gen();
+      uint64_t width = gen() % 10000;
+      uint64_t high = key > UINT64_MAX - width ? UINT64_MAX : key + width;
+      ASSERT_EQ(bf.find(key), view.find(key));
+      ASSERT_EQ(bf.findRange(key, high), view.findRange(key, high));
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (auto key : keys) {
+      ranges.emplace_back(key, key);
+    }
+    std::vector<char> found(keys.size());
+    view.findBatch(keys, reinterpret_cast<bool*>(found.data()));
+    for (auto f : found) {
+      ASSERT_TRUE(f);
+    }
+    std::fill(found.begin(), found.end(), false);
+    view.findRangeBatch(ranges, reinterpret_cast<bool*>(found.data()));
+    for (auto f : found) {
+      ASSERT_TRUE(f);
+    }
+  }
+
+  BloomRF<uint64_t> bf{BloomFilterRFParameters{8000, 3, {7, 6, 5, 4, 3}}};
+  std::vector<uint64_t> keys;
+  std::vector<char> buffer;
+};
+
+}  // namespace
+
+TEST_F(ViewTest, MatchesFilter) {
+  BloomRFView<uint64_t> view(buffer);
+  expectSameAnswers(view);
+}
+
+TEST_F(ViewTest, RejectsMisalignedBuffer) {
+  std::vector<char> shifted(buffer.size() + 1);
+  std::copy(buffer.begin(), buffer.end(), shifted.begin() + 1);
+  std::span<const char> misaligned(shifted.data() + 1, buffer.size());
+  EXPECT_THROW(BloomRFView<uint64_t>{misaligned}, std::logic_error);
+}
+
+TEST_F(ViewTest, RejectsMismatchedKeyType) {
+  EXPECT_THROW(BloomRFView<uint32_t>{buffer}, std::runtime_error);
+}
+
+TEST_F(ViewTest, DetectsCorruption) {
+  buffer[buffer.size() / 2] ^= 0x10;
+  EXPECT_THROW(BloomRFView<uint64_t>{buffer}, std::runtime_error);
+  EXPECT_NO_THROW(BloomRFView<uint64_t>(buffer, false));
+}
+
+TEST_F(ViewTest, MappedFileRoundTrip) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("bloomrf_view_" + std::to_string(::getpid()));
+  {
+    std::ofstream out(path, std::ios::binary);
+    bf.serialize(out);
+  }
+
+  {
+    MappedFile file(path.string());
+    ASSERT_EQ(file.size(), buffer.size());
+    BloomRFView<uint64_t> view(file.data());
+    expectSameAnswers(view);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFileTest, MissingFileThrows) {
+  EXPECT_THROW(MappedFile{"/nonexistent/bloomrf"}, std::system_error);
+}
+
+}  // namespace test
+}  // namespace filters
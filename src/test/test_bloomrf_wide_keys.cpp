@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+using uint128 = unsigned __int128;
+
+uint128 random128(std::mt19937_64& gen) {
+  return (static_cast<uint128>(gen()) << 64) | gen();
+}
+
+}  // namespace
+
+TEST(WideKeys, NoFalseNegatives128) {
+  std::vector<BloomFilterRFParameters> configs{
+      {8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7}},
+      // The delta vector covers all 128 bits.
+      {8000, 0, {8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}},
+      {8192, 0, {9, 8, 6, 4, 3, 2, 12, 12, 12, 12, 12, 12, 12, 12},
+       Layout::Blocked}};
+  std::mt19937_64 gen(1);
+  for (const auto& params : configs) {
+    BloomRF<uint128> bf{params};
+    std::vector<uint128> keys(300);
+    std::generate(keys.begin(), keys.end(), [&]() { return random128(gen); });
+    bf.addBatch(keys);
+    for (auto key : keys) {
+      ASSERT_TRUE(bf.find(key));
+      ASSERT_TRUE(bf.findRange(key, key));
+      ASSERT_TRUE(bf.findRange(key - gen() % 1000, key + gen() % 1000));
+    }
+  }
+}
+
+TEST(WideKeys, RangesAcrossHalves) {
+  BloomRF<uint128> bf{BloomFilterRFParameters{
+      8000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7}}};
+  // Keys just below and above 2^64, so that ranges cross the halves.
+  uint128 half = static_cast<uint128>(1) << 64;
+  bf.add(half - 3);
+  bf.add(half + 5);
+  bf.add(std::numeric_limits<uint128>::max());
+
+  ASSERT_TRUE(bf.findRange(half - 10, half - 1));
+  ASSERT_TRUE(bf.findRange(half, half + 10));
+  ASSERT_TRUE(bf.findRange(half - 1000000, half + 1000000));
+  ASSERT_TRUE(bf.findRange(0, std::numeric_limits<uint128>::max()));
+  ASSERT_TRUE(bf.findRange(std::numeric_limits<uint128>::max() - 1,
+                           std::numeric_limits<uint128>::max()));
+  ASSERT_FALSE(bf.findRange(half - 2, half + 4));
+  ASSERT_FALSE(bf.findRange(0, 1000));
+}
+
+TEST(WideKeys, Serialize128) {
+  BloomRF<uint128> bf{BloomFilterRFParameters{
+      4000, 3, {8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}}};
+  std::mt19937_64 gen(2);
+  std::vector<uint128> keys(100);
+  std::generate(keys.begin(), keys.end(), [&]() { return random128(gen); });
+  bf.addBatch(keys);
+
+  std::vector<char> buffer = bf.serialize();
+  auto copy = BloomRF<uint128>::deserialize(buffer);
+  for (auto key : keys) {
+    ASSERT_TRUE(copy.findRange(key - 1, key + 1));
+  }
+  ASSERT_THROW(BloomRF<uint64_t>::deserialize(buffer), std::runtime_error);
+}
+
+TEST(CompositeKeys, RangesWithinSeries) {
+  using Key = std::pair<uint64_t, uint64_t>;
+  BloomRF<Key> bf{BloomFilterRFParameters{
+      16000, 0, {8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}}};
+  std::mt19937_64 gen(3);
+  std::vector<uint64_t> series(20);
+  std::generate(series.begin(), series.end(), std::ref(gen));
+  std::vector<Key> keys;
+  for (auto id : series) {
+    for (uint64_t ts = 1000000; ts < 2000000; ts += 10000) {
+      keys.push_back({id, ts});
+    }
+  }
+  bf.addBatch(keys);
+
+  size_t falsePositives = 0;
+  for (auto id : series) {
+    ASSERT_TRUE(bf.findRange(id, 1000000, 1000000));
+    ASSERT_TRUE(bf.findRange(id, 1500005, 1510005));
+    ASSERT_TRUE(bf.findRange(Key{id, 1999999}, Key{id + 1, 0}));
+    // Nothing was added this late in any series.
+    uint64_t late = uint64_t{1} << 40;
+    falsePositives += bf.findRange(id, late, late + 1000);
+  }
+  ASSERT_LT(falsePositives, 4);
+
+  size_t misses = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    misses += !bf.findRange(gen(), 1000000, 2000000);
+  }
+  ASSERT_GT(misses, 950);
+}
+
+TEST(CompositeKeys, SignedComponentsKeepOrder) {
+  using Key = std::pair<int32_t, int32_t>;
+  BloomRF<Key> bf{
+      BloomFilterRFParameters{4000, 0, {7, 7, 7, 7, 7, 7, 7, 7, 7}}};
+  bf.add({-1, -5});
+  bf.add({0, std::numeric_limits<int32_t>::min()});
+  bf.add({7, 100});
+
+  ASSERT_TRUE(bf.findRange(-1, -10, 0));
+  ASSERT_FALSE(bf.findRange(-1, 0, 100));
+  // The last key of series -1 and the first of series 0 are neighbours.
+  ASSERT_TRUE(bf.findRange(Key{-1, std::numeric_limits<int32_t>::max()},
+                           Key{0, std::numeric_limits<int32_t>::min()}));
+  ASSERT_TRUE(bf.findRange(7, 50, 150));
+  ASSERT_FALSE(bf.findRange(7, 101, 1000));
+  ASSERT_TRUE(bf.find({7, 100}));
+  ASSERT_THROW(bf.findRange(Key{1, 0}, Key{0, 0}), std::logic_error);
+}
+
+TEST(CompositeKeys, NarrowPairs) {
+  // A pair of 16-bit integers is a 32-bit key.
+  using Key = std::pair<uint16_t, int16_t>;
+  BloomRF<Key> bf{BloomFilterRFParameters{4000, 0, {6, 6, 6, 6, 6}}};
+  std::vector<Key> keys{{1, -300}, {1, 300}, {2, 0}, {65535, 32767}};
+  bf.addBatch(keys);
+
+  bool out[4];
+  bf.findBatch(keys, out);
+  for (bool f : out) {
+    ASSERT_TRUE(f);
+  }
+  ASSERT_TRUE(bf.findRange(1, -400, -200));
+  ASSERT_FALSE(bf.findRange(1, -200, 200));
+  ASSERT_TRUE(bf.findRange(65535, 32000, 32767));
+}
+
+}  // namespace test
+}  // namespace filters
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "bloomRF/countingBloomRF.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+template <typename Filter>
+bool allWordsZero(const Filter& bf, size_t words) {
+  return std::all_of(bf.getFilter().get(), bf.getFilter().get() + words,
+                     [](auto word) { return word == 0; });
+}
+
+}  // namespace
+
+TEST(CountingBloomRF, RemovingAllKeysEmptiesFilter) {
+  std::vector<BloomFilterRFParameters> configs{
+      {4000, 0, {7, 7, 7, 4, 4, 2, 2, 2}},
+      {4096, 0, {9, 8, 6, 4, 3, 2}, Layout::Blocked},
+      // The top layer has PMHF words wider than UnderType.
+      {4000, 0, {6, 4, 3, 11}}};
+  std::mt19937_64 gen(1);
+  for (const auto& params : configs) {
+    CountingBloomRF<uint64_t> bf{params};
+    std::vector<uint64_t> keys(300);
+    std::generate(keys.begin(), keys.end(), std::ref(gen));
+    bf.addBatch(keys);
+    for (auto key : keys) {
+      ASSERT_TRUE(bf.find(key));
+      ASSERT_TRUE(bf.findRange(key - 10, key + 10));
+    }
+
+    bf.removeBatch(keys);
+    ASSERT_TRUE(allWordsZero(bf, 4000 / sizeof(uint64_t)));
+    for (auto key : keys) {
+      ASSERT_FALSE(bf.find(key));
+      ASSERT_FALSE(bf.findRange(key - 10, key + 10));
+    }
+  }
+}
+
+TEST(CountingBloomRF, RemoveMatchesNeverAdding) {
+  BloomFilterRFParameters params{8000, 3, {7, 7, 7, 4, 4, 2, 2, 2}};
+  CountingBloomRF<uint64_t> bf{params};
+  BloomRF<uint64_t> kept{params};
+
+  std::mt19937_64 gen(2);
+  std::vector<uint64_t> keep(500), drop(500);
+  std::generate(keep.begin(), keep.end(), std::ref(gen));
+  std::generate(drop.begin(), drop.end(), std::ref(gen));
+  bf.addBatch(keep);
+  bf.addBatch(drop);
+  kept.addBatch(keep);
+
+  bf.removeBatch(drop);
+  for (size_t i = 0; i < 8000 / sizeof(uint64_t); ++i) {
+    ASSERT_EQ(bf.getFilter()[i], kept.getFilter()[i]);
+  }
+  for (auto key : keep) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(bf.findRange(key - gen() % 1000, key + gen() % 1000));
+  }
+}
+
+TEST(CountingBloomRF, SaturatedCountersStick) {
+  CountingBloomRF<uint64_t> bf{BloomFilterRFParameters{4000, 0, {6, 4, 3}}};
+  for (size_t i = 0; i < 20; ++i) {
+    bf.add(42);
+  }
+  for (size_t i = 0; i < 20; ++i) {
+    bf.remove(42);
+  }
+  ASSERT_TRUE(bf.find(42));
+
+  // A key whose prefixes differ from those of 42 on every layer.
+  uint64_t other = uint64_t{1} << 40;
+  bf.add(other);
+  bf.add(other);
+  bf.remove(other);
+  ASSERT_TRUE(bf.find(other));
+  bf.remove(other);
+  ASSERT_FALSE(bf.find(other));
+}
+
+TEST(CountingBloomRF, SignedFloatAndSmallUnderType) {
+  BloomFilterRFParameters params{4000, 0, {6, 4, 3, 2}};
+  CountingBloomRF<int64_t> signedBf{params};
+  CountingBloomRF<double> floatBf{params};
+  CountingBloomRF<uint64_t, uint32_t> small{params};
+
+  std::vector<int64_t> keys{-1000000, -5, 0, 17, 1000000};
+  for (auto key : keys) {
+    signedBf.add(key);
+    floatBf.add(key * 0.5);
+    small.add(static_cast<uint64_t>(key));
+  }
+  for (auto key : keys) {
+    ASSERT_TRUE(signedBf.findRange(key - 1, key + 1));
+    ASSERT_TRUE(floatBf.findRange(key * 0.5 - 0.1, key * 0.5 + 0.1));
+    ASSERT_TRUE(small.find(static_cast<uint64_t>(key)));
+  }
+  for (auto key : keys) {
+    signedBf.remove(key);
+    floatBf.remove(key * 0.5);
+    small.remove(static_cast<uint64_t>(key));
+  }
+  ASSERT_TRUE(allWordsZero(signedBf, 4000 / sizeof(uint64_t)));
+  ASSERT_TRUE(allWordsZero(floatBf, 4000 / sizeof(uint64_t)));
+  ASSERT_TRUE(allWordsZero(small, 4000 / sizeof(uint32_t)));
+}
+
+}  // namespace test
+}  // namespace filters
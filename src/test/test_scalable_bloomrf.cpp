@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "bloomRF/scalableBloomRF.h"
+#include "test_helpers.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+ScalableBloomRFParameters smallParams(
+    Layout layout = Layout::Flat,
+    size_t blockedLayers = 0) {
+  return ScalableBloomRFParameters{
+      BloomFilterRFParameters{1024, 0, {7, 7, 7, 4, 4, 2, 2, 2}, layout,
+                              blockedLayers},
+      16};
+}
+
+}  // namespace
+
+TEST(ScalableBloomRF, GrowsAndKeepsAllKeys) {
+  ScalableBloomRF<uint64_t> bf{smallParams()};
+  ASSERT_EQ(bf.numGenerations(), 1);
+
+  std::mt19937_64 gen(1);
+  std::vector<uint64_t> keys(5000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  for (size_t i = 0; i < 100; ++i) {
+    bf.add(keys[i]);
+  }
+  bf.addBatch(std::span<const uint64_t>(keys).subspan(100));
+
+  // 512, 910, 1638, ... keys per generation.  A few keys are false
+  // positives already and are not counted.
+  ASSERT_GT(bf.numGenerations(), 3);
+  ASSERT_LE(bf.size(), keys.size());
+  ASSERT_GT(bf.size(), keys.size() * 99 / 100);
+  ASSERT_GT(bf.fillRatio(), 0);
+  ASSERT_LE(bf.fillRatio(), 1);
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(bf.findRange(key - gen() % 100, key + gen() % 100));
+  }
+}
+
+TEST(ScalableBloomRF, FalsePositivesStayBounded) {
+  std::mt19937_64 gen(2);
+  std::vector<uint64_t> keys(20000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+
+  ScalableBloomRF<uint64_t> scalable{smallParams()};
+  BloomRF<uint64_t> fixed{smallParams().initial};
+  scalable.addBatch(keys);
+  fixed.addBatch(keys);
+
+  size_t scalableFound = 0, fixedFound = 0;
+  for (size_t i = 0; i < 10000; ++i) {
+    uint64_t low = gen();
+    scalableFound += scalable.findRange(low, low + 1000);
+    fixedFound += fixed.findRange(low, low + 1000);
+  }
+  ASSERT_GT(fixedFound, 9000);
+  ASSERT_LT(scalableFound, 1000);
+}
+
+TEST(ScalableBloomRF, CompactKeepsAllKeys) {
+  for (auto layout : {Layout::Flat, Layout::Blocked}) {
+    ScalableBloomRF<uint64_t> bf{
+        smallParams(layout, layout == Layout::Blocked ? 3 : 0)};
+    std::mt19937_64 gen(3);
+    std::vector<uint64_t> keys(4000);
+    std::generate(keys.begin(), keys.end(), std::ref(gen));
+    bf.addBatch(keys);
+    size_t before = bf.memoryBytes();
+
+    // Generations of 1, 2, 4 and 8 KiB take 512, 910 and 1638 keys, and
+    // the last one about 940 at 22 bits per key, which fit into 4 KiB.
+    ASSERT_EQ(bf.numGenerations(), 4);
+    size_t size = bf.size();
+    bf.compact();
+    ASSERT_TRUE(bf.isFrozen());
+    ASSERT_EQ(bf.numGenerations(), 4);
+    ASSERT_EQ(bf.size(), size);
+    ASSERT_EQ(before, 15 * 1024);
+    ASSERT_EQ(bf.memoryBytes(), 11 * 1024);
+    for (auto key : keys) {
+      ASSERT_TRUE(bf.find(key));
+      ASSERT_TRUE(bf.findRange(key - gen() % 100, key + gen() % 100));
+    }
+    ASSERT_THROW(bf.add(1), std::logic_error);
+  }
+}
+
+TEST(ScalableBloomRF, RepeatedKeysDoNotGrow) {
+  ScalableBloomRF<uint64_t> bf{smallParams()};
+  std::vector<uint64_t> keys(100);
+  std::iota(keys.begin(), keys.end(), uint64_t{1} << 40);
+  for (size_t i = 0; i < 100; ++i) {
+    bf.addBatch(keys);
+    bf.add(keys[i]);
+  }
+  ASSERT_EQ(bf.numGenerations(), 1);
+  ASSERT_LE(bf.size(), keys.size());
+  ASSERT_LT(bf.fillRatio(), 0.25);
+}
+
+TEST(ScalableBloomRF, GenerationsHaveTheirOwnSeeds) {
+  auto params = smallParams();
+  params.initial.seed = 7;
+  ScalableBloomRF<uint64_t> bf{params};
+  std::mt19937_64 gen(4);
+  std::vector<uint64_t> keys(2000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  bf.addBatch(keys);
+  ASSERT_GT(bf.numGenerations(), 2);
+
+  // The seed follows magic, version and four type bytes.
+  std::set<uint64_t> seeds;
+  for (size_t i = 0; i < bf.numGenerations(); ++i) {
+    std::vector<char> buffer = bf.getGeneration(i).serialize();
+    uint64_t seed;
+    std::memcpy(&seed, &buffer[12], sizeof(seed));
+    seeds.insert(seed);
+  }
+  ASSERT_EQ(seeds.size(), bf.numGenerations());
+  ASSERT_TRUE(seeds.count(7));
+}
+
+TEST(ScalableBloomRF, SignedKeysAndBatches) {
+  ScalableBloomRF<int64_t> bf{smallParams()};
+  std::vector<int64_t> keys;
+  for (int64_t i = -2000; i < 2000; ++i) {
+    keys.push_back(i * 1000);
+  }
+  bf.addBatch(keys);
+
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  for (auto key : keys) {
+    ranges.emplace_back(key - 10, key + 10);
+  }
+  std::unique_ptr<bool[]> out(new bool[ranges.size()]);
+  bf.findRangeBatch(ranges, out.get());
+  ASSERT_TRUE(std::all_of(out.get(), out.get() + ranges.size(),
+                          [](bool found) { return found; }));
+
+  QueryStats stats;
+  ASSERT_TRUE(bf.findRange(-5, 5, stats));
+  ASSERT_GT(stats.queries, 0);
+}
+
+TEST(ScalableBloomRF, InvalidParameters) {
+  auto params = smallParams();
+  params.growth = 3;
+  ASSERT_THROW(ScalableBloomRF<uint64_t>{params}, std::logic_error);
+  ASSERT_THROW(ScalableBloomRF<uint64_t>{smallParams(Layout::Blocked)},
+               std::logic_error);
+  params = smallParams();
+  params.initial.layer_sizes = {512, 512, 0, 0, 0, 0, 0, 0};
+  ASSERT_THROW(ScalableBloomRF<uint64_t>{params}, std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters
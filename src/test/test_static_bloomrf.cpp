@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bloomRF/staticBloomRF.h"
+
+namespace filters {
+namespace test {
+
+namespace {
+
+/// Builds a StaticBloomRF and a BloomRF with the same configuration from the
+/// same keys and checks that they hold the same words and answer point
+/// queries alike.  BloomRF::findRange may test the last interval that
+/// straddles hkey together with the covered ones on its layer instead of
+/// refining it, so StaticBloomRF::findRange only has to find no more.
+template <typename Key, typename UnderType, size_t... Delta>
+void expectSameAsDynamic(size_t filterSize, uint64_t keyMask) {
+  StaticBloomRF<Key, UnderType, Delta...> bf{filterSize, 3};
+  BloomRF<Key, UnderType> dynamic{
+      BloomFilterRFParameters{filterSize, 3, {Delta...}}};
+
+  std::mt19937_64 gen(11);
+  for (size_t i = 0; i < 2000; ++i) {
+    Key key = gen() & keyMask;
+    bf.add(key);
+    dynamic.add(key);
+  }
+  for (size_t i = 0; i < (filterSize + sizeof(UnderType) - 1) /
+                             sizeof(UnderType);
+       ++i) {
+    ASSERT_EQ(bf.getFilter()[i], dynamic.getFilter()[i]);
+  }
+
+  for (size_t i = 0; i < 20000; ++i) {
+    Key low = gen() & keyMask;
+    Key high = low + static_cast<Key>(gen() % (uint64_t{1} << (i % 40)));
+    if (high < low) {
+      std::swap(low, high);
+    }
+    ASSERT_EQ(bf.find(low), dynamic.find(low));
+    if (bf.findRange(low, high)) {
+      ASSERT_TRUE(dynamic.findRange(low, high)) << low << " " << high;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(StaticBloomRF, MatchesDynamic) {
+  expectSameAsDynamic<uint64_t, uint64_t, 7, 7, 7, 4, 4, 2, 2, 2>(
+      4000, ~uint64_t{0});
+  // Sparse keys, so that range queries come back empty.
+  expectSameAsDynamic<uint64_t, uint64_t, 9, 8, 6, 4, 3, 2>(16000,
+                                                            ~uint64_t{0});
+  // PMHF words wider than UnderType.
+  expectSameAsDynamic<uint32_t, uint64_t, 11, 10, 4, 3>(8000, 0xffffffff);
+  expectSameAsDynamic<uint64_t, uint32_t, 8, 7, 6, 5>(8000, 0xfffffff);
+  expectSameAsDynamic<uint16_t, uint64_t, 4, 4, 4, 4>(1000, 0xffff);
+  expectSameAsDynamic<uint16_t, uint64_t, 16>(8192, 0xffff);
+}
+
+TEST(StaticBloomRF, NoFalseNegatives) {
+  StaticBloomRF<uint64_t, uint64_t, 9, 8, 6, 4, 3, 2> bf{16000, 0};
+  std::mt19937_64 gen(5);
+  std::vector<uint64_t> keys(1000);
+  std::generate(keys.begin(), keys.end(), std::ref(gen));
+  bf.addBatch(keys);
+  for (auto key : keys) {
+    ASSERT_TRUE(bf.find(key));
+    ASSERT_TRUE(bf.findRange(key, key));
+    ASSERT_TRUE(bf.findRange(key - rand() % 1000, key + rand() % 1000));
+    ASSERT_TRUE(bf.findRange(key < 100 ? 0 : key - 100,
+                             std::numeric_limits<uint64_t>::max()));
+  }
+}
+
+TEST(StaticBloomRF, RejectsInvalidArguments) {
+  using Filter = StaticBloomRF<uint64_t, uint64_t, 4, 4>;
+  EXPECT_THROW(Filter(0, 0), std::logic_error);
+  // A PMHF word of the lowest layer spans 2^15 bits.
+  using Wide = StaticBloomRF<uint16_t, uint64_t, 16>;
+  EXPECT_THROW(Wide(1000, 0), std::logic_error);
+  Filter bf{64, 0};
+  EXPECT_THROW(bf.findRange(2, 1), std::logic_error);
+}
+
+}  // namespace test
+}  // namespace filters